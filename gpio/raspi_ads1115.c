@@ -10,12 +10,13 @@ Raspberry Pi用 I2C 16bit ADコンバータ TI ADS1113 ADS1114 ADS1115
 ・アドレス ADDR PIN=GND:0x48, VDD:0x49, SDA:0x4A, SCL:0x4B
 
 コンパイル方法
-    make または gcc -Wall -O1 raspi_ads1115.c soft_i2c.o -o raspi_ads1115
+    make または gcc -Wall -O1 raspi_ads1115.c soft_i2c.o i2c_sim.o i2c_bench.o -o raspi_ads1115
 
 使い方
     ./raspi_ads1115                     デフォルトで動作
     ./raspi_ads1115 48                  I2Cアドレスを0x48に設定
     ./raspi_ads1115 48 1                入力数を1に設定(ADS1113 ADS1114)
+    ./raspi_ads1115 --bench 100         100回続けて測定し、測定速度と所要時間の内訳を表示
 
                                         Copyright (c) 2014-2017 Wataru KUNINO
                                         https://bokunimo.net/raspi/
@@ -41,12 +42,9 @@ int16_t i2c_adc(int ain){
     i2c_write(i2c_address,config,3);        // レジスタ 0x03設定
     
     delay(8);                               // 測定待ち8ms (1/128 sec.)
-    config[0]=0x00;                         // 変換
-    i2c_write(i2c_address,config,1);        // レジスタ 0x03設定
-    
-    delay(8);                               // 測定待ち8ms
+    config[0]=0x00;                         // 変換結果レジスタ
     memset(data,0,2);
-    i2c_read(i2c_address,data,2);           // 測定の実行
+    i2c_write_read(i2c_address,config,1,data,2);    // 結果の読み出し
     return (((int16_t)data[0])<<8)|(int16_t)data[1];
 }
 
@@ -54,6 +52,8 @@ int main(int argc,char **argv){
     int i,ch=4;
     int16_t adc;
     
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);
     if( argc >= 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
     if(i2c_address>=0x80) i2c_address>>=1;
     if( argc == 3 ) ch=atoi(argv[2]);
@@ -64,16 +64,19 @@ int main(int argc,char **argv){
     #endif
     
     i2c_init();
-    for(i=0;i<ch;i++){
-        adc=i2c_adc(i);                     // AD変換器の値を取得
-        if(adc<0)adc=0;                     // GND電位によって負値が出る対策
-        printf("%0.1f",((float)(adc))/32767.*2046.);	// 結果出力[mV]
-        #ifdef DEBUG
-            printf("(%04x)",adc);           // 16進数での表示(DEBUG用)
-        #endif
-        if(i < ch-1) putchar(' ');          // 区切り文字(スペース)出力
-    }
-    putchar('\n');
+    do{
+        i2c_bench_begin();
+        for(i=0;i<ch;i++){
+            adc=i2c_adc(i);                 // AD変換器の値を取得
+            if(adc<0)adc=0;                 // GND電位によって負値が出る対策
+            printf("%0.1f",((float)(adc))/32767.*2046.);	// 結果出力[mV]
+            #ifdef DEBUG
+                printf("(%04x)",adc);       // 16進数での表示(DEBUG用)
+            #endif
+            if(i < ch-1) putchar(' ');      // 区切り文字(スペース)出力
+        }
+        putchar('\n');
+    }while(i2c_bench_end());
     i2c_close();
     return 0;
 }
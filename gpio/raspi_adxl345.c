@@ -7,12 +7,13 @@ Raspberry Pi用 I2C 加速度センサ Analog Devices 社 ADXL345
 ・I2C接続の加速度センサの値を読み取る
 
 コンパイル方法
-    make または gcc -Wall -O1 raspi_adxl345.c soft_i2c.o -o raspi_adxl345
+    make または gcc -Wall -O1 raspi_adxl345.c soft_i2c.o i2c_sim.o i2c_bench.o -o raspi_adxl345
 
 使い方
     ./raspi_adxl345                     デフォルトで動作
     ./raspi_adxl345 1D                  I2Cアドレスを0x1Dに設定
     ./raspi_adxl345 53                  I2Cアドレスを0x53に設定(SDO=Lのとき)
+    ./raspi_adxl345 --bench 100         100回続けて測定し、測定速度と所要時間の内訳を表示
 
                                         Copyright (c) 2016-2017 Wataru KUNINO
                                         https://bokunimo.net/raspi/
@@ -29,8 +30,7 @@ byte i2c_address=0x1D; // ADXL345 の I2C アドレス SDO=L時は 0x53 へ要
 
 int _getReg(byte reg){
     byte data=0x00;
-    i2c_write(i2c_address,&reg,1);
-	if(!i2c_read(i2c_address,&data,1)) return -1;
+	if(!i2c_write_read(i2c_address,&reg,1,&data,1)) return -1;
 	return (int)data;
 }
 
@@ -40,12 +40,17 @@ void _setReg(byte reg,byte value){
     i2c_write(i2c_address,data,2);
 }
 
+void _setRegQ(i2c_batch *q,byte reg,byte value){
+    byte data[2];                           // 一括実行用(データは追加時に複写される)
+    data[0]=reg; data[1]=value;
+    i2c_batch_write(q,i2c_address,data,2);
+}
+
 int _getData(int reg){
     byte data[2];
     int16_t val;
     data[0]=(byte)reg;
-    i2c_write(i2c_address,data,1);
-	if(!i2c_read(i2c_address,data,2)) return -99999;
+	if(!i2c_write_read(i2c_address,data,1,data,2)) return -99999;
 	val= data[0];
 	val |= data[1]<<8;
     return (int)val;
@@ -72,6 +77,9 @@ int adxlSetup(int range){
     /* I2Cの開始 */
 //  i2c_init();                             // I2Cインタフェースの使用を開始
 
+    i2c_batch q;                            // 設定レジスタの書込みは一括実行
+    byte reg=0x2D, pwr=0xFF;
+
     /* ID確認 */    
     if(_getReg(0x00) != 0xE5) return -1;    // レジスタ0x00—DEVID（読出し専用）
 /*
@@ -82,14 +90,19 @@ int adxlSetup(int range){
 */
 
     /* 割込み禁止 */
-    _setReg(0x2E,0x00);                     // レジスタ0x2E—INT_ENABLE（読出し／書込み）
-    _setReg(0x2C,0b00001010);               // レジスタ0x2C—BW_RATE（読出し／書込み）
+    i2c_batch_clear(&q);
+    _setRegQ(&q,0x2E,0x00);                 // レジスタ0x2E—INT_ENABLE（読出し／書込み）
+    _setRegQ(&q,0x2C,0b00001010);           // レジスタ0x2C—BW_RATE（読出し／書込み）
     //             | |||__|_____ Rate       1111:140uA  1110:90uA 1000:60uA
     //             | ||_________ LOW_POWER
     //             |_|__________ 0
 
-    if(_getReg(0x2D) == 0x00){
+    i2c_batch_write_read(&q,i2c_address,&reg,1,&pwr,1);   // POWER_CTL を読む
+    if(i2c_batch_run(&q)!=q.n) return -1;  // 途中の命令が失敗(追加時の上限超過も含む)
+
+    if(pwr == 0x00){
         /* 測定レンジ設定 */
+        i2c_batch_clear(&q);
         if(range<0||range>3) range=0;
         range |= 0b00101000;
         //         ||||||||_____ Range      -> 変数 rangeから
@@ -99,10 +112,10 @@ int adxlSetup(int range){
         //         |||__________ INT_INVERT -> 1 (割込みピンを負論理に Lアクティブ)
         //         ||___________ SPI
         //         |____________ SELF_TEST
-        _setReg(0x31,range);                // DATA_FORMAT（アドレス0x31）
+        _setRegQ(&q,0x31,range);            // DATA_FORMAT（アドレス0x31）
 
         /* 割込み用のスレッシュレベルを設定 */
-        _setReg(0x1D,0x08);                 // レジスタ0x1D—THRESH_TAP（読出し／書込み）
+        _setRegQ(&q,0x1D,0x08);             // レジスタ0x1D—THRESH_TAP（読出し／書込み）
                                             // 0x01 62.5 mg/LSB
                                             // 0x08  500 mg
                                             // 0x10    1 g 重力加速度
@@ -110,7 +123,7 @@ int adxlSetup(int range){
                                             // 0xFF 約16 g
 
         /* 割込み用のスレッシュ時間値を設定 */
-        _setReg(0x21,0xA0);                 // レジスタ0x1D—THRESH_TAP（読出し／書込み）
+        _setRegQ(&q,0x21,0xA0);             // レジスタ0x1D—THRESH_TAP（読出し／書込み）
                                             // 0x01   625 us/LSB
                                             // 0x10    10 ms
                                             // 0x50    50 ms
@@ -118,7 +131,7 @@ int adxlSetup(int range){
                                             // 0xFF 約160 ms
 
         /* 割込み用のDOUBLE_TAP無視時間値を設定 */
-        _setReg(0x22,0x00);                 // レジスタ0x22—Latent（読出し／書込み）
+        _setRegQ(&q,0x22,0x00);             // レジスタ0x22—Latent（読出し／書込み）
                                             // 0x01 1.25ms/LSB
                                             // 0x10   20 ms
                                             // 0x50  100 ms
@@ -126,26 +139,27 @@ int adxlSetup(int range){
                                             // 0xFF 約320 ms
 
         /* 割込み用のDOUBLE_TAP検出時間値を設定 */
-        _setReg(0x23,0x00);                 // レジスタ0x23—Window（読出し／書込み）
+        _setRegQ(&q,0x23,0x00);             // レジスタ0x23—Window（読出し／書込み）
                                             // 0x01 1.25ms/LSB
                                             // 0x10   20 ms
                                             // 0x50  100 ms
                                             // 0xA0  200 ms
                                             // 0xFF 約320 ms
         /* 割込み用の軸を設定 */
-        _setReg(0x2A,0b00000111);           // レジスタ0x2A—TAP_AXES（読出し／書込み）
+        _setRegQ(&q,0x2A,0b00000111);       // レジスタ0x2A—TAP_AXES（読出し／書込み）
         //             |  |||||_____ Z
         //             |  ||||______ Y
         //             |  |||_______ X
         //             |  ||________ Suppress
         //             |__|_________ 0
 
-        _setReg(0x1E,0x00);
-        _setReg(0x1F,0x00);
-        _setReg(0x20,0x00);
+        _setRegQ(&q,0x1E,0x00);
+        _setRegQ(&q,0x1F,0x00);
+        _setRegQ(&q,0x20,0x00);
         /* 測定開始 */
-        _setReg(0x2D,0b00001000);
-        delay(100);
+        _setRegQ(&q,0x2D,0b00001000);
+        i2c_batch_delay(&q,100);
+        if(i2c_batch_run(&q)!=q.n) return -1;
         
         /* 重力値を減算する*/
         /*
@@ -233,7 +247,10 @@ int main(int argc,char **argv){
     int i,start;
     float acm;
     
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);
     if( argc >= 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
+    else if( i2c_inventory(0x1D)==0 && i2c_inventory(0x53)>0 ) i2c_address=0x53;  // raspi_i2cdetect の検索結果
     if(i2c_address>=0x80) i2c_address>>=1;
     #ifdef DEBUG
         printf("address =0x%02X\n",i2c_address);
@@ -248,12 +265,15 @@ int main(int argc,char **argv){
         default: printf("Accem ERROR\n");          break;
     }
 	#endif
-    for(i=0;i<3;i++){
-        acm=getAcm(i);                      // 加速度を取得
-        printf("%0.1f",acm);				// 結果出力[mV]
-        if(i < 2) putchar(' ');          	// 区切り文字(スペース)出力
-    }
-    putchar('\n');
+    do{
+        i2c_bench_begin();
+        for(i=0;i<3;i++){
+            acm=getAcm(i);                  // 加速度を取得
+            printf("%0.1f",acm);            // 結果出力[mV]
+            if(i < 2) putchar(' ');         // 区切り文字(スペース)出力
+        }
+        putchar('\n');
+    }while(i2c_bench_end());
     adxlEnd();
     i2c_close();
     return start;
@@ -26,13 +26,13 @@ int i2c_temp(){
     byte data[8];
     byte config[3];
     
-    i2c_write(i2c_address,config,0);    // 起動コマンド
-    delay(15);                          // 起動待ち
+    i2c_write(i2c_address,config,0);    // 起動コマンド(STOP前に0.8ms待つ)
+    delay(1);                           // 起動待ち(0.8ms～3ms)
     config[0]=0x03;                     // readコマンド
     config[1]=0x00;                     // 開始アドレス
     config[2]=0x04;                     // データ長
     i2c_write(i2c_address,config,3);    // レジスタ 0x03設定
-    delay(15);                          // 測定待ち15ms
+    delay(2);                           // 測定待ち(1.5ms以上)
     i2c_read(i2c_address,data,6);       // 読み出し
     temp = (((int16_t)data[4])<<8)+((int16_t)data[5]);
     hum  = (((int16_t)data[2])<<8)+((int16_t)data[3]);
@@ -43,10 +43,15 @@ int i2c_hum(){
     return (int)hum;
 }
 
-int main(void){
+int main(int argc,char **argv){
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);              // --bench N: N回続けて測定
     i2c_init();
-    printf("%3.1f ",((float)i2c_temp())/10.);
-    printf("%3.1f\n",((float)i2c_hum())/10.);
+    do{
+        i2c_bench_begin();
+        printf("%3.1f ",((float)i2c_temp())/10.);
+        printf("%3.1f\n",((float)i2c_hum())/10.);
+    }while(i2c_bench_end());
     i2c_close();
     return 0;
 }
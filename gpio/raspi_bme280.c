@@ -16,9 +16,15 @@ I2C接続のセンサから測定値を取得する
                                         https://bokunimo.net/raspi/
 *******************************************************************************/
 
-// usage: raspi_bme280 [address]
+// usage: raspi_bme280 [-n] [-r] [-oT,P,H] [-fFILTER] [--bench N] [address]
 //                      0x76    Lowの時
 //                      0x77    HIghの時
+//        -n            ノーマルモード(連続測定)で動作 (既定はフォースドモード)
+//        -oT,P,H       オーバサンプリング 0:無し 1:x1 2:x2 3:x4 4:x8 5:x16 (既定1,1,1)
+//                      -o2 のように1つだけ指定すると全てに適用
+//        -fFILTER      IIRフィルタ 0:OFF 1:2 2:4 3:8 4:16 (既定0)
+//        -r            補正値のキャッシュ(/run/raspi_bme280)を使わずに読み直す
+//        --bench N     N回続けて測定し、測定速度と所要時間の内訳を表示
 //
 // The last bit is changeable by SDO value and can be changed during operation.
 // Connecting SDO to GND results in slave address 1110110 (0x76); 
@@ -29,7 +35,12 @@ I2C接続のセンサから測定値を取得する
 	#include <stdio.h>
 	#include <stdlib.h>
 	#include <string.h>
+	#include <errno.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
 	#include "../libs/soft_i2c.h"
+#else
+	#define i2c_bench_wait(ms) delay(ms)	// 変換待ち(Raspberry Pi では --bench で集計)
 #endif
 typedef uint8_t byte; 
 uint8_t I2C_bme280=0x76;
@@ -135,8 +146,7 @@ uint16_t _bme280_getReg(byte reg){
 	#ifdef ARDUINO
 		Wire.beginTransmission(I2C_bme280);
 		Wire.write(reg);
-		if( Wire.endTransmission()==0){
-			delay(1);
+		if( Wire.endTransmission(false)==0){	// Repeated START
 			Wire.requestFrom((int)I2C_bme280,(int)1);
 			if(Wire.available()==0) return -2;
 			return Wire.read();
@@ -144,69 +154,246 @@ uint16_t _bme280_getReg(byte reg){
 		return -1;
 	#else
 		byte data;
-		i2c_write(I2C_bme280,&reg,1);	   // 書込みの実行
-		delay(1);
-		i2c_read(I2C_bme280,&data,1);	   // 読み出し
+		if(!i2c_write_read(I2C_bme280,&reg,1,&data,1)) return -1;	// 書込みと読み出し
 		return (int)data;
 	#endif
 }
 
-void _bme280_cal(){
-	dig_T1 = (u16)(_bme280_getReg(0x88) + (_bme280_getReg(0x89)<<8));
-	dig_T2 = (s16)(_bme280_getReg(0x8A) + (_bme280_getReg(0x8B)<<8));
-	dig_T3 = (s16)(_bme280_getReg(0x8C) + (_bme280_getReg(0x8D)<<8));
-	dig_P1 = (u16)(_bme280_getReg(0x8E) + (_bme280_getReg(0x8F)<<8));
-	dig_P2 = (s16)(_bme280_getReg(0x90) + (_bme280_getReg(0x91)<<8));
-	dig_P3 = (s16)(_bme280_getReg(0x92) + (_bme280_getReg(0x93)<<8));
-	dig_P4 = (s16)(_bme280_getReg(0x94) + (_bme280_getReg(0x95)<<8));
-	dig_P5 = (s16)(_bme280_getReg(0x96) + (_bme280_getReg(0x97)<<8));
-	dig_P6 = (s16)(_bme280_getReg(0x98) + (_bme280_getReg(0x99)<<8));
-	dig_P7 = (s16)(_bme280_getReg(0x9A) + (_bme280_getReg(0x9B)<<8));
-	dig_P8 = (s16)(_bme280_getReg(0x9C) + (_bme280_getReg(0x9D)<<8));
-	dig_P9 = (s16)(_bme280_getReg(0x9E) + (_bme280_getReg(0x9F)<<8));
-	dig_H1 = (u8)(_bme280_getReg(0xA1));
-	dig_H2 = (s16)(_bme280_getReg(0xE1) + (_bme280_getReg(0xE2)<<8));
-	dig_H3 = (u8)(_bme280_getReg(0xE3));
-	dig_H4 = (s16)((_bme280_getReg(0xE4)<<4) + (_bme280_getReg(0xE5)&0x0F));
-	dig_H5 = (s16)(((_bme280_getReg(0xE5)&0xF0)>>4) + (_bme280_getReg(0xE6)<<4));
-	dig_H6 = (s8)(_bme280_getReg(0xE7));
+int _bme280_getRegs(byte reg, byte *rx, int len){
+// 連続したレジスタを自動インクリメントで一括で読み出す 戻り値：０以外はエラー
+	#ifdef ARDUINO
+		int i;
+		Wire.beginTransmission(I2C_bme280);
+		Wire.write(reg);
+		if( Wire.endTransmission(false)!=0) return -1;
+		Wire.requestFrom((int)I2C_bme280,len);
+		for(i=0;i<len;i++){
+			if(Wire.available()==0) return -2;
+			rx[i]=Wire.read();
+		}
+		return 0;
+	#else
+		return i2c_write_read(I2C_bme280,&reg,1,rx,(byte)len)!=len;
+	#endif
+}
+
+void _bme280_cal_parse(byte *c, byte *h){
+// c:0x88～0xA1(26バイト) h:0xE1～0xE7(7バイト)
+	dig_T1 = (u16)(c[0] + (c[1]<<8));
+	dig_T2 = (s16)(c[2] + (c[3]<<8));
+	dig_T3 = (s16)(c[4] + (c[5]<<8));
+	dig_P1 = (u16)(c[6] + (c[7]<<8));
+	dig_P2 = (s16)(c[8] + (c[9]<<8));
+	dig_P3 = (s16)(c[10] + (c[11]<<8));
+	dig_P4 = (s16)(c[12] + (c[13]<<8));
+	dig_P5 = (s16)(c[14] + (c[15]<<8));
+	dig_P6 = (s16)(c[16] + (c[17]<<8));
+	dig_P7 = (s16)(c[18] + (c[19]<<8));
+	dig_P8 = (s16)(c[20] + (c[21]<<8));
+	dig_P9 = (s16)(c[22] + (c[23]<<8));
+	dig_H1 = (u8)(c[25]);				// 0xA1 (0xA0は未使用)
+	dig_H2 = (s16)(h[0] + (h[1]<<8));
+	dig_H3 = (u8)(h[2]);
+	dig_H4 = (s16)((h[3]<<4) + (h[4]&0x0F));
+	dig_H5 = (s16)(((h[4]&0xF0)>>4) + (h[5]<<4));
+	dig_H6 = (s8)(h[6]);
+}
+
+int _bme280_cal(){
+// 戻り値：０以外はエラー
+	byte c[26];							// 0x88～0xA1
+	byte h[7];							// 0xE1～0xE7
+	if(_bme280_getRegs(0x88,c,26) || _bme280_getRegs(0xE1,h,7)) return 1;
+	_bme280_cal_parse(c,h);
+	return 0;
+}
+
+#ifndef ARDUINO
+/* 補正値のキャッシュ
+	補正値はチップ固有で変化しないため、バス名・アドレス・chip_id ごとに
+	ファイルへ保存し、次回起動時は先頭6バイト(0x88～0x8D)の CRC の一致を
+	確認するだけで補正値の読み出しを省略する。
+	保存先は環境変数 BME280_CACHE、無ければ /run/raspi_bme280 (書けなければ /tmp)
+*/
+#define BME280_CACHE	"/run/raspi_bme280"
+#define BME280_CACHE_LEN	(4+26+7+2)	// "BMEc" + 補正値 + CRC(検証用,全体)
+int bme280_cache_refresh=0;				// 1:キャッシュを使わずに読み直す(-r)
+
+byte _bme280_crc8(byte *d, int len){
+	byte crc=0xFF;
+	int i,j;
+	for(i=0;i<len;i++){
+		crc ^= d[i];
+		for(j=0;j<8;j++) crc = (crc & 0x80) ? (byte)((crc<<1)^0x31) : (byte)(crc<<1);
+	}
+	return crc;
+}
+
+void _bme280_cache_path(char *path, int size, byte id){
+	const char *dir=getenv("BME280_CACHE");
+	if(dir==NULL || dir[0]=='\0'){
+		dir=BME280_CACHE;
+		if(mkdir(dir,0755) && errno!=EEXIST) dir="/tmp";
+	}
+	snprintf(path,size,"%s/bme280_%s_%02X_%02X.cal",dir,i2c_bus_name(),I2C_bme280,id);
+}
+
+int _bme280_cal_cached(byte id){
+// 戻り値：０以外はエラー
+	char path[128],tmp[136];
+	byte d[BME280_CACHE_LEN];
+	byte v[6];
+	FILE *fp;
+	int n=0;
+
+	_bme280_cache_path(path,sizeof(path),id);
+	if(!bme280_cache_refresh && (fp=fopen(path,"rb"))){
+		n=fread(d,1,BME280_CACHE_LEN,fp);
+		fclose(fp);
+	}
+	if( n==BME280_CACHE_LEN && !memcmp(d,"BMEc",4) &&
+		d[BME280_CACHE_LEN-1]==_bme280_crc8(d,BME280_CACHE_LEN-1) &&
+		!_bme280_getRegs(0x88,v,6) && d[BME280_CACHE_LEN-2]==_bme280_crc8(v,6) ){
+		#ifdef DEBUG
+			printf("cal cache  %s\n",path);
+		#endif
+		_bme280_cal_parse(&d[4],&d[4+26]);
+		return 0;
+	}
+	memcpy(d,"BMEc",4);
+	if(_bme280_getRegs(0x88,&d[4],26) || _bme280_getRegs(0xE1,&d[4+26],7)) return 1;
+	_bme280_cal_parse(&d[4],&d[4+26]);
+	d[BME280_CACHE_LEN-2]=_bme280_crc8(&d[4],6);
+	d[BME280_CACHE_LEN-1]=_bme280_crc8(d,BME280_CACHE_LEN-1);
+	snprintf(tmp,sizeof(tmp),"%s.%d",path,(int)getpid());
+	fp=fopen(tmp,"wb");
+	if(fp==NULL) return 0;				// 保存できなくても補正値は読めている
+	n=fwrite(d,1,BME280_CACHE_LEN,fp);
+	fclose(fp);
+	if(n!=BME280_CACHE_LEN || rename(tmp,path)) remove(tmp);
+	return 0;
+}
+#endif
+
+/* 測定設定 */
+#define BME280_SLEEP	0
+#define BME280_FORCED	1				// 1回測定してスリープ(既定)
+#define BME280_NORMAL	3				// 連続測定
+byte bme280_osrs_t=1;					// オーバサンプリング 0:無し 1:x1 2:x2 3:x4 4:x8 5:x16
+byte bme280_osrs_p=1;
+byte bme280_osrs_h=1;
+byte bme280_filter=0;					// IIRフィルタ 0:OFF 1:2 2:4 3:8 4:16
+byte bme280_t_sb=0;						// NORMAL時の待機時間 0:0.5ms ～ 7:20ms
+byte bme280_mode=BME280_FORCED;
+
+int32_t _bme280_adc_T, _bme280_adc_P, _bme280_adc_H;
+byte _bme280_fresh=0;					// 未取得の測定値 bit0:温度 bit1:湿度 bit2:気圧
+
+void bme280_config(byte osrs_t, byte osrs_p, byte osrs_h, byte filter, byte mode){
+	bme280_osrs_t = osrs_t>5 ? 5 : osrs_t;
+	bme280_osrs_p = osrs_p>5 ? 5 : osrs_p;
+	bme280_osrs_h = osrs_h>5 ? 5 : osrs_h;
+	bme280_filter = filter>4 ? 4 : filter;
+	bme280_mode = (mode==BME280_NORMAL) ? BME280_NORMAL : BME280_FORCED;
+}
+
+int _bme280_meas_time(){
+// 最大測定時間[ms] (データシート 9.1 t_measure,max)
+	int us=1250;
+	if(bme280_osrs_t) us += 2300*(1<<(bme280_osrs_t-1));
+	if(bme280_osrs_p) us += 2300*(1<<(bme280_osrs_p-1)) + 575;
+	if(bme280_osrs_h) us += 2300*(1<<(bme280_osrs_h-1)) + 575;
+	return (us+999)/1000;
+}
+
+byte _bme280_ctrl_meas(byte mode){
+	return (byte)((bme280_osrs_t<<5) | (bme280_osrs_p<<2) | mode);
+	//				 | || |||___________________ mode[1:0]
+	//				 | ||_|_____________________ osrs_p[2:0]
+	//				 |_|________________________ osrs_t[2:0]
+}
+
+int _bme280_wait(){
+// 測定完了(status の measuring[3] が0)を待つ 戻り値：０以外はタイムアウト
+	int i;
+	byte in;
+	i2c_bench_wait(_bme280_meas_time());
+	for(i=0;i<50;i++){
+		in=_bme280_getReg(0xF3);
+		#ifdef DEBUG
+			#ifdef ARDUINO
+				Serial.print("getReg 0x");
+				Serial.println(in,HEX);
+			#else
+				printf("getReg   %02X\n",in);
+			#endif
+		#endif
+		if((in&0x08)==0) return 0;
+		i2c_bench_wait(1);
+	}
+	return 1;
+}
+
+int bme280_measure(){
+// 気圧・温度・湿度を同じ測定から取得する 戻り値：０以外はエラー
+	byte d[8];							// 0xF7～0xFE
+	if(bme280_mode==BME280_FORCED){
+		if(_bme280_setByte(0xF4,_bme280_ctrl_meas(BME280_FORCED))) return 13;
+		if(_bme280_wait()) return 31;
+	}
+	if(_bme280_getRegs(0xF7,d,8)) return 32;
+	_bme280_adc_P = ((int32_t)d[0]<<12) | ((int32_t)d[1]<<4) | (d[2]>>4);
+	_bme280_adc_T = ((int32_t)d[3]<<12) | ((int32_t)d[4]<<4) | (d[5]>>4);
+	_bme280_adc_H = ((int32_t)d[6]<<8) | d[7];
+	BME280_compensate_T_int32(_bme280_adc_T);	// 気圧・湿度用に t_fine を更新
+	_bme280_fresh=0x07;
+	return 0;
+}
+
+int _bme280_update(byte bit){
+// 測定値 bit が取得済みなら測定し直す 戻り値：０以外はエラー(表示済み)
+	int err=0;
+	if(!(_bme280_fresh & bit)) err=bme280_measure();
+	_bme280_fresh &= ~bit;
+	if(err){
+		#ifdef ARDUINO
+			Serial.print("ERROR(");
+			Serial.print(err);
+			Serial.println("): failed to read results");
+		#else
+			fprintf(stderr,"ERROR(%d): failed to read results\n",err);
+		#endif
+	}
+	return err;
 }
 
 float bme280_getTemp(){
-	int32_t in;
-	in = _bme280_getReg(0xFA);			  		// temp_msb[7:0]
-	in <<= 8;
-	in |= _bme280_getReg(0xFB); 				// temp_lsb[7:0]
-	in <<= 4;
-	in |= _bme280_getReg(0xFC); 				// temp_xlsb[3:0]
-//	  printf("getTemp  %08X %d\n",in,in);
-	return ((float)BME280_compensate_T_int32(in))/100.;
+	if(_bme280_update(0x01)) return -999.;
+//	  printf("getTemp  %08X %d\n",_bme280_adc_T,_bme280_adc_T);
+	return ((float)BME280_compensate_T_int32(_bme280_adc_T))/100.;
 }
 
 
 float bme280_getHum(){
-	int32_t in;
-	in = _bme280_getReg(0xFD);			  		// hum_msb[7:0]
-	in <<= 8;
-	in |= _bme280_getReg(0xFE); 				// hum_lsb[7:0]
-//	printf("getHum   %08X\n",in);
-	return ((float)bme280_compensate_H_int32(in))/1024.;
+	if(_bme280_update(0x02)) return -999.;
+//	printf("getHum   %08X\n",_bme280_adc_H);
+	return ((float)bme280_compensate_H_int32(_bme280_adc_H))/1024.;
 }
 
 float bme280_getPress(){
-	int32_t in;
-	in = _bme280_getReg(0xF7);					// press_msb[7:0]
-	in <<= 8;
-	in |= _bme280_getReg(0xF8); 	 			// press_lsb[7:0]
-	in <<= 4;
-	in |= _bme280_getReg(0xF9);				// press_xlsb[3:0]
-//	printf("getPress %08X\n",in);
-	return ((float)BME280_compensate_P_int64(in))/25600.;
+	if(_bme280_update(0x04)) return -999.;
+//	printf("getPress %08X\n",_bme280_adc_P);
+	return ((float)BME280_compensate_P_int64(_bme280_adc_P))/25600.;
 }
 
 int bme280_init(){
 	byte reg,data,in;
-	int i;
+	byte w[4][2];						// 設定レジスタと書込み値
+	static const int w_err[4]={13,11,12,13};
+	static const char *w_name[4]={"ctrl_meas","config","trl_hum","ctrl_meas"};
+	#ifndef ARDUINO
+		i2c_batch q;
+	#endif
 	
 	#ifdef ARDUINO
 		Wire.begin();
@@ -214,79 +401,78 @@ int bme280_init(){
 		i2c_init();
 	#endif
 	
-	_bme280_cal();
-	
-	reg= 0xF5;				   	// config
-//	data=0b11000000;
-	data=0b00000000;
-	//	   | || | |___________________ 触るな SCI切換え
-	//	   | ||_|_____________________ filter[2:0]
-	//	   |_|________________________ t_sb[2:0]
-	if(_bme280_setByte(reg,data)){		// 書込みの実行
+	in=_bme280_getReg(0xD0);
+	if(in != 0x58 && in != 0x60){
 		#ifdef ARDUINO
-			Serial.println("ERROR(11): i2c writing config reg");
+			Serial.print("ERROR(21):  chip_id = 0x");
+			Serial.println(in,HEX);
 		#else
-			fprintf(stderr,"ERROR(11): i2c writing config reg\n");
+			fprintf(stderr,"ERROR(21):  chip_id (%02X)\n",in);
 		#endif
-		return 11;
+		return 21;
 	}
 	
-	reg= 0xF2;				   	// trl_hum
-	data=0b00000001;
-	//			|_|___________________ osrs_h[2:0]
-	if(_bme280_setByte(reg,data)){		// 書込みの実行
+	#ifdef ARDUINO
+		reg=_bme280_cal();
+	#else
+		reg=_bme280_cal_cached(in);
+	#endif
+	if(reg){
 		#ifdef ARDUINO
-			Serial.println("ERROR(12): i2c writing trl_hum reg");
+			Serial.println("ERROR(22): i2c reading calibration");
 		#else
-			fprintf(stderr,"ERROR(12): i2c writing trl_hum reg\n");
+			fprintf(stderr,"ERROR(22): i2c reading calibration\n");
 		#endif
-		return 12;
+		return 22;
 	}
 	
-	reg= 0xF4;				   	// ctrl_meas
-	data=0b00100111;
-	//	   | || |||___________________ mode[1:0]
-	//	   | ||_|_____________________ osrs_p[2:0]
-	//	   |_|________________________ osrs_t[2:0]
-	if(_bme280_setByte(reg,data)){		// 書込みの実行
-		#ifdef ARDUINO
-			Serial.println("ERROR(13): i2c writing ctrl_meas reg");
-		#else
-			fprintf(stderr,"ERROR(13): i2c writing ctrl_meas reg\n");
-		#endif
-		return 13;
-	}	 
-	in=_bme280_getReg(0xD0);
-	if(in != 0x58 && in != 0x60){
+	/* 設定レジスタの書込み (Linux では一括実行) */
+	reg=0;
+	w[reg][0]=0xF4;				// ctrl_meas (設定変更のためスリープ)
+	w[reg++][1]=_bme280_ctrl_meas(BME280_SLEEP);
+	w[reg][0]=0xF5;				// config
+	w[reg++][1]=(byte)((bme280_t_sb<<5) | (bme280_filter<<2));
+	//	   | || | |___________________ 触るな SCI切換え
+	//	   | ||_|_____________________ filter[2:0]
+	//	   |_|________________________ t_sb[2:0]
+	w[reg][0]=0xF2;				// trl_hum (ctrl_meas の書込みで有効になる)
+	w[reg++][1]=bme280_osrs_h;
+	//			|_|___________________ osrs_h[2:0]
+	if(bme280_mode==BME280_NORMAL){
+		w[reg][0]=0xF4;			// ctrl_meas
+		w[reg++][1]=_bme280_ctrl_meas(BME280_NORMAL);
+	}
+	#ifdef ARDUINO
+		for(data=0;data<reg && !_bme280_setByte(w[data][0],w[data][1]);data++);
+	#else
+		i2c_batch_clear(&q);
+		for(data=0;data<reg;data++) i2c_batch_write(&q,I2C_bme280,w[data],2);
+		data=(byte)i2c_batch_run(&q);	// 成功した書込み数
+	#endif
+	if(data<reg){
 		#ifdef ARDUINO
-			Serial.print("ERROR(21):  chip_id = 0x");
-			Serial.println(in,HEX);
+			Serial.print("ERROR(");
+			Serial.print(w_err[data]);
+			Serial.print("): i2c writing ");
+			Serial.print(w_name[data]);
+			Serial.println(" reg");
 		#else
-			fprintf(stderr,"ERROR(21):  chip_id (%02X)\n",in);
+			fprintf(stderr,"ERROR(%d): i2c writing %s reg\n",w_err[data],w_name[data]);
 		#endif
-		return 21;
+		return w_err[data];
 	}
-	for(i=0;i<50;i++){
-		in=_bme280_getReg(0xF3);
-		#ifdef DEBUG
+	
+	if(bme280_mode==BME280_NORMAL){
+		if(_bme280_wait()){				// 最初の測定を待つ
 			#ifdef ARDUINO
-				Serial.print("getReg 0x");
-				Serial.println(in,HEX);
+				Serial.println("ERROR(31): failed to read results");
 			#else
-				printf("getReg   %02X\n",in);
+				fprintf(stderr,"ERROR(31): failed to read results\n");
 			#endif
-		#endif
-		if((in&0x04)==0) break;
-		delay(20);
-	}
-	if(i==50){
-		#ifdef ARDUINO
-			Serial.println("ERROR(31): failed to read results");
-		#else
-			fprintf(stderr,"ERROR(31): failed to read results\n");
-		#endif
-		return 31;
+			return 31;
+		}
 	}
+	_bme280_fresh=0;
 	return 0;
 }
 
@@ -316,18 +502,44 @@ void bme280_print(float temp, float hum, float press){
 
 #ifndef ARDUINO
 int main(int argc,char **argv){
-	if( argc == 2 ) I2C_bme280=(byte)strtol(argv[1],NULL,16);
+	int num=1;
+	int o_t=1,o_p=1,o_h=1,filter=0,mode=BME280_FORCED;
+	char c,*opt;
+	i2c_stats_opt(&argc,argv);
+	i2c_bench_opt(&argc,argv);
+	while(argc >=num+1 && argv[num][0]=='-'){
+		c=argv[num][1];
+		opt=&argv[num][2];
+		if(c!='n' && c!='r' && opt[0]=='\0' && argc > num+1){
+			num++;
+			opt=argv[num];
+		}
+		if(c=='n') mode=BME280_NORMAL;
+		if(c=='o' && sscanf(opt,"%d,%d,%d",&o_t,&o_p,&o_h)==1) o_p=o_h=o_t;
+		if(c=='f') filter=atoi(opt);
+		if(c=='r') bme280_cache_refresh=1;
+		num++;
+	}
+	if( argc == num+1 ) I2C_bme280=(byte)strtol(argv[num],NULL,16);
+	else if( i2c_inventory(0x76)==0 && i2c_inventory(0x77)>0 ) I2C_bme280=0x77;	// raspi_i2cdetect の検索結果
 	if( I2C_bme280>=0x80 ) I2C_bme280>>=1;
-	if( argc < 1 || argc > 2 ){
-		fprintf(stderr,"usage: %s [I2C_bme280]\n",argv[0]);
+	if( argc > num+1 ){
+		fprintf(stderr,"usage: %s [-n] [-r] [-oT,P,H] [-fFILTER] [--bench N] [I2C_bme280]\n",argv[0]);
 		return -1;
 	}
 	#ifdef DEBUG
 		printf("I2C_bme280 =0x%02X\n",I2C_bme280);
 	#endif
 
-	bme280_init();
-	bme280_print(bme280_getTemp(),bme280_getHum(),bme280_getPress());
+	bme280_config(o_t,o_p,o_h,filter,mode);
+	if(bme280_init()){					// エラーは表示済み
+		i2c_close();
+		return -1;
+	}
+	do{
+		i2c_bench_begin();
+		bme280_print(bme280_getTemp(),bme280_getHum(),bme280_getPress());
+	}while(i2c_bench_end());
 	bme280_stop();
 	return 0;
 }
@@ -13,7 +13,7 @@ AMS CCS811 Carbon Monoxide CO VOCs Air Quality Numerical Gas Sensors
                                         https://bokunimo.net/raspi/
 *******************************************************************************/
 
-// usage: raspi_ccs811 [i2c_address]
+// usage: raspi_ccs811 [--bench N] [i2c_address]
 //                      0x5A    When ADDR is low
 //                      0x5B    When ADDR is high
 
@@ -29,9 +29,7 @@ byte i2c_address=0x5A;
 uint8_t _ccs811_getByte(byte reg){
     uint8_t tx=reg;
     uint8_t rx;
-    i2c_write(i2c_address,&tx,1);       // 書込みの実行
-    delay(10);
-    i2c_read(i2c_address,&rx,1);
+    i2c_write_read(i2c_address,&tx,1,&rx,1);   // 読出し(準備中はクロックストレッチで待つ)
     #ifdef DEBUG
     //  printf("rx=%02x\n",rx);
     #endif
@@ -42,9 +40,7 @@ int _ccs811_getReg(byte reg, byte *rx, int len){
     uint8_t tx=reg;
     int i;
     if(len < 0 || len>8) return -1;
-    i2c_write(i2c_address,&tx,1);       // 書込みの実行
-    delay(10);
-    i=i2c_read(i2c_address,(byte *)rx,len);
+    i=i2c_write_read(i2c_address,&tx,1,(byte *)rx,len);
     #ifdef DEBUG
         printf("rx[%d]=",i);
         for(i=0;i<len;i++){
@@ -75,9 +71,7 @@ int _ccs811_getVals(){
         int current;
     #endif
     
-    i2c_write(i2c_address,&tx,1);       // 書込みの実行
-    delay(20);
-    len=i2c_read(i2c_address,rx,8);
+    len=i2c_write_read(i2c_address,&tx,1,rx,8);
     
     i=((int)rx[6])*256+(int)rx[7];
     adc = i & 0x03FF;
@@ -121,9 +115,7 @@ int setEnv(float temp, float hum){
 int getCO2(){                           // 二酸化炭素濃度（ppm)を取得
     uint8_t tx=0x02;                    // 0x02 ALG_RESULT_DATA
     uint8_t rx[2];
-    i2c_write(i2c_address,&tx,1);
-    delay(20);
-    if(i2c_read(i2c_address,rx,2) != 2) return -1;
+    if(i2c_write_read(i2c_address,&tx,1,rx,2) != 2) return -1;
     return ((int)rx[0])*256+(int)rx[1];
 }
 
@@ -202,10 +194,12 @@ int setup(){
 int main(int argc,char **argv){
     int co2=0;
     
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);
     if( argc == 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
     if( i2c_address>=0x80 ) i2c_address>>=1;
     if( argc < 1 || argc > 2 ){
-        fprintf(stderr,"usage: %s [i2c_address]\n",argv[0]);
+        fprintf(stderr,"usage: %s [--bench N] [i2c_address]\n",argv[0]);
         return -1;
     }
     #ifdef DEBUG
@@ -213,15 +207,19 @@ int main(int argc,char **argv){
     #endif
 
     setup();
-    while(co2==0){
-        co2=getCO2();
-        if(co2>0) break;
-        #ifdef DEBUG
-        if(co2==0) co2=_ccs811_getVals();
-        #endif
-        delay(1000);
-    }
-    printf("%d\n",co2);
+    do{
+        i2c_bench_begin();
+        co2=0;
+        while(co2==0){
+            co2=getCO2();
+            if(co2>0) break;
+            #ifdef DEBUG
+            if(co2==0) co2=_ccs811_getVals();
+            #endif
+            i2c_bench_wait(1000);           // 最初の測定結果を待つ
+        }
+        printf("%d\n",co2);
+    }while(i2c_bench_end());
     i2c_close();
     return 0;
 }
@@ -10,6 +10,13 @@ Arduino標準ライブラリ「Wire」は使用していない(I2Cの手順の
 I2C接続の温湿度センサの値を読み取る
 TI社 HDC1000
 
+使い方
+    ./raspi_hdc1000                 アドレス 0x40 のセンサを測定
+    ./raspi_hdc1000 41              アドレスを指定
+    ./raspi_hdc1000 70:0 70:1 71:0:41   TCA9548A(アドレス:チャネル[:センサのアドレス])
+                                    経由の複数のセンサを測定(1行に1台ずつ表示)
+    ./raspi_hdc1000 --bench 100     100回続けて測定し、測定速度と所要時間の内訳を表示
+
                                         Copyright (c) 2014-2017 Wataru KUNINO
                                         https://bokunimo.net/raspi/
 *******************************************************************************/
@@ -23,11 +30,12 @@ TI社 HDC1000
 #include "../libs/soft_i2c.h"
 typedef unsigned char byte; 
 byte i2c_address=0x40;				// HDC1000 の I2C アドレス 
+#define MUX_MAX 16					// mux 経由で測定するセンサの最大数
 
 uint16_t _getReg(byte data){
 	byte rx[2];
     i2c_write(i2c_address,&data,1);	// 書込みの実行
-    delay(10);						// 6.5ms以上
+    delay(10);						// 6.5ms以上 (変換時間のため Repeated START 不可)
     i2c_read(i2c_address,rx,2);		// 読み出し
     return (((uint16_t)rx[0])<<8)|((uint16_t)rx[1]);
 }
@@ -46,13 +54,89 @@ float getHum(){
     return (float)ret / 65536. * 100.;
 }
 
+void _setOps(i2c_mux_op *ops, int n, byte reg, byte *rx){
+// 各センサへの書込み(rx==NULL)または2バイトの読み出しを設定する
+    int i;
+    for(i=0;i<n;i++){
+        ops[i].tx[0]=reg;
+        ops[i].tx[1]=0x00;
+        ops[i].tx[2]=0x00;
+        ops[i].txlen = rx ? 0 : (reg==0x02 ? 3 : 1);
+        ops[i].rxlen = rx ? 2 : 0;
+        ops[i].rx = rx ? &rx[i*4+(reg&1)*2] : NULL;
+    }
+}
+
+int main_mux(int n, char **argv){
+// TCA9548A 経由の複数のセンサを、チャネルごとにまとめて測定する
+    i2c_mux_op ops[MUX_MAX];
+    byte rx[MUX_MAX*4];
+    byte ok[MUX_MAX];
+    unsigned int mux,adr;
+    int i,ch;
+    float temp,hum;
+
+    for(i=0;i<n;i++){
+        adr=0x40;
+        if( sscanf(argv[i],"%x:%d:%x",&mux,&ch,&adr)<2 || mux>=0x80 || ch<0 || ch>7 || adr>=0x80 ){
+            fprintf(stderr,"ERROR: %s (MUX:CH[:ADR])\n",argv[i]);
+            return -1;
+        }
+        memset(&ops[i],0,sizeof(i2c_mux_op));
+        ops[i].mux=mux;
+        ops[i].ch=ch;
+        ops[i].adr=adr;
+    }
+    memset(rx,0,sizeof(rx));
+    i2c_init();
+	delay(18);							// 15ms以上
+    _setOps(ops,n,0x02,NULL);           // 設定レジスタ 02
+    i2c_mux_run(ops,n);
+    delay(20);
+    do{
+        i2c_bench_begin();
+        memset(ok,1,sizeof(ok));        // 測定ごとに成否を判定
+        for(i=0;i<2;i++){               // 温度レジスタ 00、湿度レジスタ 01
+            _setOps(ops,n,i,NULL);      // 全センサの変換を開始してから
+            i2c_mux_run(ops,n);
+            delay(10);                  // 6.5ms以上
+            _setOps(ops,n,i,rx);        // まとめて読み出す
+            i2c_mux_run(ops,n);
+            for(ch=0;ch<n;ch++) ok[ch] &= ops[ch].status!=0;
+        }
+        for(i=0;i<n;i++){
+            temp = (float)((rx[i*4]<<8)|rx[i*4+1]) / 65536. * 165. - 40.;
+            hum = (float)((rx[i*4+2]<<8)|rx[i*4+3]) / 65536. * 100.;
+            if(ok[i]) printf("%s %3.2f %4.2f\n",argv[i],temp,hum);
+            else printf("%s -999 -999\n",argv[i]);
+        }
+    }while(i2c_bench_end());
+    #ifdef DEBUG
+    {
+        uint32_t skip, sel=i2c_mux_stats(&skip);
+        fprintf(stderr,"mux select %u (skipped %u)\n",sel,skip);
+    }
+    #endif
+    i2c_close();
+    return 0;
+}
+
 int main(int argc,char **argv){
     byte config[3];
 
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);
+    if( argc >= 2 && strchr(argv[1],':') ){
+        if( argc-1 > MUX_MAX ){
+            fprintf(stderr,"usage: %s [MUX:CH[:ADR]]... (max %d)\n",argv[0],MUX_MAX);
+            return -1;
+        }
+        return main_mux(argc-1,&argv[1]);
+    }
     if( argc >= 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
     if(i2c_address>=0x80) i2c_address>>=1;
     if( argc < 1 || argc > 2 ){
-        fprintf(stderr,"usage: %s [i2c_address]\n",argv[0]);
+        fprintf(stderr,"usage: %s [--bench N] [i2c_address]\n",argv[0]);
         return -1;
     }
 
@@ -64,8 +148,11 @@ int main(int argc,char **argv){
     i2c_write(i2c_address,config,3);    // 書込みの実行
     delay(20);
 
-    printf("%3.2f ",getTemp());
-    printf("%4.2f\n",getHum());
+    do{
+        i2c_bench_begin();
+        printf("%3.2f ",getTemp());
+        printf("%4.2f\n",getHum());
+    }while(i2c_bench_end());
     
     i2c_close();
     return 0;
@@ -0,0 +1,328 @@
+/*******************************************************************************
+Raspberry Pi用 ソフトウェアI2C ベンチマーク raspi_i2cbench
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+・模擬 sysfs GPIO ツリーと模擬 GPIO レジスタ(一時ディレクトリ)を作成し、
+  soft_i2c の GPIO 方式ごとに i2c_tx の送信速度(bytes/sec)を測定します。
+・実機の GPIO には触れないので、Raspberry Pi 以外の Linux でも動作します。
+・模擬 sysfs の value ファイルはプルアップされないため、sysfs, fd 方式では
+  クロックストレッチの確認を行いません(SOFT_I2C_STRETCH=0)。
+・1バイトあたりの GPIO 操作回数(io)と、状態が同じため省略した回数(elided)を
+  表示します。
+・suite は基本操作(digitalWrite/digitalRead/pinMode、i2c_SDA/i2c_SCL、i2c_tx、
+  i2c_write/i2c_read/i2c_write_read)ごとに、方式別の処理速度(ops/sec)と
+  1回の所要時間の分布(p50/p90/p99/最大[ns])をタブ区切りで出力します
+  (リリース間の比較用、make bench)。使えない方式(gpiochip 等)は飛ばします。
+  GPIO 方式はスレーブのいない模擬バス(sysfs, fd は value を H に固定)なので
+  ACK を確認せず、sim 方式は BME280 のモデル(0x76)と通信します。
+  i2c_SDA/i2c_SCL/i2c_tx はシンボル長0(待ちなし)で方式の処理時間のみを、
+  i2c_write/i2c_read/i2c_write_read は設定の速度(SOFT_I2C_SPEED)で測定します。
+
+コンパイル方法
+    make または gcc -Wall -O1 raspi_i2cbench.c soft_i2c.o i2c_sim.o i2c_bench.o -o raspi_i2cbench
+
+使い方
+    ./raspi_i2cbench                    sysfs, fd, mmap で各200バイトを送信
+    ./raspi_i2cbench 1000               送信バイト数を1000に設定
+    ./raspi_i2cbench 1000 fd            指定した方式のみ測定
+    SOFT_I2C_SPEED=fast ./raspi_i2cbench    400kHz 設定で測定 (standard:100kHz)
+    LD_PRELOAD=./mock_dev.so ./raspi_i2cbench 1000 gpiochip   模擬 gpiochip で測定
+    ./raspi_i2cbench 1000 lanes         SDA 1本と4本(SCL共有)の同時通信を比較(mmap)
+    ./raspi_i2cbench suite              sysfs, fd, gpiochip, mmap, sim で各500回
+    ./raspi_i2cbench suite 2000 fd mmap > fd_mmap.tsv   回数と方式を指定
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "../libs/soft_i2c.h"
+typedef unsigned char byte;
+
+#define SUITE_N     500                     // suite の操作ごとの既定の測定回数
+#define SUITE_ADR   0x76                    // suite の通信先 (sim では BME280 のモデル)
+#define SUITE_FREE  1000000000              // ライン操作の測定速度[Hz] (シンボル長0、待ちなし)
+
+char sim_root[]="/tmp/raspi_i2cbench_XXXXXX";
+int sim_stretch=1;                          // 1:方式に応じて SOFT_I2C_STRETCH を設定
+
+int sim_file(const char *name, const char *value){
+    char path[128];
+    FILE *fp;
+    snprintf(path,sizeof(path),"%s/%s",sim_root,name);
+    fp=fopen(path,"w");
+    if(fp==NULL) return -1;
+    fputs(value,fp);
+    fclose(fp);
+    return 0;
+}
+
+void sim_reset(){
+    char path[128];
+    int i;
+    for(i=2;i<=3;i++){                      // SDA=gpio2, SCL=gpio3
+        snprintf(path,sizeof(path),"gpio%d/direction",i);
+        sim_file(path,"in");
+        snprintf(path,sizeof(path),"gpio%d/value",i);
+        sim_file(path,"1\n");               // プルアップ状態から開始
+    }
+}
+
+void sim_pullup(){
+// 最初の L 出力で書かれた value を H に戻す (以降は方向の切換えのみなので、
+// 読み取りは常に H になり、プルアップのかわりになる)
+    sim_file("gpio2/value","1\n");
+    sim_file("gpio3/value","1\n");
+}
+
+int sim_setup(){
+    char path[128];
+    int i;
+    if(mkdtemp(sim_root)==NULL) return -1;
+    sim_file("export","");
+    sim_file("unexport","");
+    for(i=2;i<=3;i++){
+        snprintf(path,sizeof(path),"%s/gpio%d",sim_root,i);
+        mkdir(path,0755);
+    }
+    sim_reset();
+    setenv("SOFT_I2C_SYSFS",sim_root,1);
+    snprintf(path,sizeof(path),"%s/gpiomem",sim_root);
+    setenv("SOFT_I2C_GPIOMEM",path,1);      // 模擬 GPIO レジスタ
+    return 0;
+}
+
+void sim_cleanup(){
+    char path[128];
+    const char *names[]={"export","unexport",
+        "gpio2/direction","gpio2/value","gpio3/direction","gpio3/value",
+        "gpio2","gpio3","gpiomem",NULL};
+    int i;
+    for(i=0;names[i];i++){
+        snprintf(path,sizeof(path),"%s/%s",sim_root,names[i]);
+        remove(path);
+    }
+    rmdir(sim_root);
+}
+
+double bench(const char *backend, int len){
+    struct timespec t0,t1;
+    double sec,hz,jitter;
+    uint32_t io,elided;
+    int i;
+
+    sim_reset();
+    setenv("SOFT_I2C_BACKEND",backend,1);
+    if(sim_stretch){
+        if(!strcmp(backend,"sysfs") || !strcmp(backend,"fd")) setenv("SOFT_I2C_STRETCH","0",1);
+        else unsetenv("SOFT_I2C_STRETCH");
+    }
+    if(!i2c_init()){
+        fprintf(stderr,"ERROR: i2c_init (%s)\n",backend);
+        return -1.;
+    }
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    for(i=0;i<len;i++) i2c_tx(0x55);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    sec = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    i2c_scl_stats(&hz,&jitter);
+    io=i2c_io_stats(&elided);
+    printf("%-8s %6d bytes %9.3f sec %10.1f bytes/sec  SCL %8.1f Hz jitter %6.1f us  io %.1f elided %.1f /byte\n",
+        i2c_backend_name(),len,sec,(double)len/sec,hz,jitter/1000.,(double)io/len,(double)elided/len);
+    i2c_close();
+    return (double)len/sec;
+}
+
+double bench_lanes(int lanes, int len){
+    int sda[]={2,4,5,6};                    // GPIO0～9 (GPFSEL0)に並べる
+    byte tx=0xF7, rx[4*8], ack=0;           // BME280 の測定値 8バイトを想定
+    struct timespec t0,t1;
+    double sec;
+    i2c_bus *b;
+    int i;
+
+    setenv("SOFT_I2C_BACKEND","mmap",1);
+    unsetenv("SOFT_I2C_STRETCH");
+    b=i2c_bus_new_lanes(sda,lanes,3);
+    if(b==NULL || !i2c_init_ex(b)){
+        fprintf(stderr,"ERROR: i2c_init (lanes)\n");
+        i2c_bus_free(b);
+        return -1.;
+    }
+    i2c_set_error_check_ex(b,0);            // 模擬バスにはスレーブがいない
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    for(i=0;i<len;i+=8) ack=i2c_write_read_lanes(b,0x76,&tx,1,rx,8);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    sec = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("lanes=%d  %6d bytes %9.3f sec %10.1f bytes/sec  (ack %02X)\n",
+        lanes,len*lanes,sec,(double)len*lanes/sec,ack);
+    i2c_close_ex(b);
+    i2c_bus_free(b);
+    return (double)len*lanes/sec;
+}
+
+enum { OP_DIGITAL_WRITE, OP_DIGITAL_READ, OP_PIN_MODE, OP_SDA, OP_SCL, OP_TX,
+    OP_WRITE, OP_READ, OP_WRITE_READ, OPS };
+const char *op_name[OPS]={"digitalWrite","digitalRead","pinMode","i2c_SDA","i2c_SCL","i2c_tx",
+    "i2c_write","i2c_read","i2c_write_read"};
+const int op_bytes[OPS]={0,0,0,0,0,1,2,2,3};    // 1回の送受信データのバイト数
+
+void suite_op(int op, int i, char *port){
+    byte reg=0xD0, tx[2]={0xF4,0x00}, rx[2];    // BME280 の chip_id と ctrl_meas(休止)
+    switch(op){
+        case OP_DIGITAL_WRITE:  digitalWrite(port,i&1); break;
+        case OP_DIGITAL_READ:   digitalRead(port); break;
+        case OP_PIN_MODE:       pinMode(port,(i&1) ? "out" : "in"); break;
+        case OP_SDA:            i2c_SDA(i&1); break;
+        case OP_SCL:            i2c_SCL(i&1); break;
+        case OP_TX:             i2c_tx(0x55); break;
+        case OP_WRITE:          i2c_write(SUITE_ADR,tx,2); break;
+        case OP_READ:           i2c_read(SUITE_ADR,rx,2); break;
+        case OP_WRITE_READ:     i2c_write_read(SUITE_ADR,&reg,1,rx,2); break;
+    }
+}
+
+int cmp_u64(const void *a, const void *b){
+    uint64_t x=*(const uint64_t *)a, y=*(const uint64_t *)b;
+    return (x>y)-(x<y);
+}
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void suite_run(const char *backend, int op, int n, uint64_t *ns, char *port){
+// op を n 回実行し、1行(方式 操作 回数 バイト数 ops/sec p50 p90 p99 最大)を出力する
+    uint64_t t0,t,start;
+    int i;
+    for(start=t=now_ns(),i=0;i<n;i++){
+        t0=t;
+        suite_op(op,i,port);
+        t=now_ns();
+        ns[i]=t-t0;
+    }
+    qsort(ns,n,sizeof(uint64_t),cmp_u64);
+    printf("%s\t%s\t%d\t%d\t%.1f\t%llu\t%llu\t%llu\t%llu\n",backend,op_name[op],n,op_bytes[op],
+        n*1e9/(double)(t-start),(unsigned long long)ns[(n-1)*50/100],(unsigned long long)ns[(n-1)*90/100],
+        (unsigned long long)ns[(n-1)*99/100],(unsigned long long)ns[n-1]);
+    fflush(stdout);
+}
+
+uint32_t suite_speed(){
+// SOFT_I2C_SPEED の速度[Hz] (0:既定)
+    const char *env=getenv("SOFT_I2C_SPEED");
+    if(env==NULL) return 0;
+    if(!strcmp(env,"standard")) return 100000;
+    if(!strcmp(env,"fast")) return 400000;
+    return (uint32_t)atol(env);
+}
+
+int suite(int n, char **backends){
+    char *defaults[]={"sysfs","fd","gpiochip","mmap","sim",NULL};
+    const char *speed=getenv("SOFT_I2C_SPEED");
+    char port[128];
+    uint64_t *ns;
+    int i,op,gpio;
+
+    ns=(uint64_t *)malloc(n*sizeof(uint64_t));
+    if(ns==NULL) return -1;
+    if(backends[0]==NULL) backends=defaults;
+    snprintf(port,sizeof(port),"%s/gpio2/value",sim_root);
+    printf("# raspi_i2cbench suite n=%d speed=%s (i2c_SDA/i2c_SCL/i2c_tx unpaced)\n",n,speed ? speed : "default");
+    printf("backend\top\tn\tbytes\tops_per_sec\tp50_ns\tp90_ns\tp99_ns\tmax_ns\n");
+    for(i=0;backends[i];i++){
+        sim_reset();
+        if(!strcmp(backends[i],"sysfs")){   // sysfs のファイル操作(方式によらない)
+            for(op=OP_DIGITAL_WRITE;op<=OP_PIN_MODE;op++) suite_run("sysfs",op,n,ns,port);
+            sim_reset();
+        }
+        setenv("SOFT_I2C_BACKEND",backends[i],1);
+        if(sim_stretch){
+            if(!strcmp(backends[i],"sysfs") || !strcmp(backends[i],"fd")) setenv("SOFT_I2C_STRETCH","0",1);
+            else unsetenv("SOFT_I2C_STRETCH");
+        }
+        if(!i2c_init()){
+            fprintf(stderr,"# %s: i2c_init Error (skipped)\n",backends[i]);
+            continue;
+        }
+        if(strncmp(i2c_backend_name(),backends[i],strlen(backends[i]))){   // mmap-sim は mmap
+            fprintf(stderr,"# %s: not available (skipped)\n",backends[i]);
+            i2c_close();
+            continue;
+        }
+        gpio=strcmp(backends[i],"sim") && strcmp(backends[i],"i2cdev") && strcmp(backends[i],"i2cd");
+        i2c_set_error_check_ex(i2c_bus_default(),!gpio);   // 模擬バスにはスレーブがいない
+        if(gpio){                           // ライン操作は待ちなしで方式の処理時間を測る
+            i2c_set_speed(SUITE_FREE);
+            for(op=OP_SDA;op<=OP_TX;op++){
+                sim_pullup();
+                suite_run(backends[i],op,n,ns,port);
+            }
+            i2c_set_speed(suite_speed());   // 通信は設定の速度で測る
+        }
+        for(op=OP_WRITE;op<OPS;op++){
+            sim_pullup();
+            suite_run(backends[i],op,n,ns,port);
+        }
+        i2c_close();
+    }
+    free(ns);
+    return 0;
+}
+
+int main(int argc,char **argv){
+    char *defaults[]={"sysfs","fd","mmap",NULL};
+    char **backends=defaults;
+    double base=0.,bps;
+    int len=200;
+    int i;
+
+    if( argc >= 2 && !strcmp(argv[1],"suite") ){
+        len = argc>=3 ? atoi(argv[2]) : SUITE_N;
+        if( len<=0 || sim_setup() ){
+            fprintf(stderr,"usage: %s suite [count] [backend...]\n",argv[0]);
+            return -1;
+        }
+        if( getenv("SOFT_I2C_STRETCH") ) sim_stretch=0;
+        fprintf(stderr,"# simulated sysfs: %s\n",sim_root);
+        i=suite(len,argc>=3 ? &argv[3] : &argv[2]);
+        sim_cleanup();
+        return i;
+    }
+    if( argc >= 2 ) len=atoi(argv[1]);
+    if( len<=0 ){
+        fprintf(stderr,"usage: %s [bytes] [backend...]\n",argv[0]);
+        return -1;
+    }
+    if( argc >= 3 ) backends=&argv[2];      // argv[argc]はNULL
+    if( getenv("SOFT_I2C_STRETCH") ) sim_stretch=0;
+    if(sim_setup()){
+        fprintf(stderr,"ERROR: cannot create %s\n",sim_root);
+        return -1;
+    }
+    printf("simulated sysfs: %s\n",sim_root);
+    for(i=0;backends[i];i++){
+        if(!strcmp(backends[i],"lanes")){
+            base=bench_lanes(1,len);
+            bps=bench_lanes(4,len);
+            if(base>0 && bps>0) printf("lanes=4  x%.2f (vs lanes=1)\n",bps/base);
+            continue;
+        }
+        bps=bench(backends[i],len);
+        if(bps<=0) continue;
+        if(base<=0) base=bps;
+        else printf("%-8s x%.2f (vs %s)\n",backends[i],bps/base,backends[0]);
+    }
+    sim_cleanup();
+    return 0;
+}
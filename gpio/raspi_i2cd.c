@@ -0,0 +1,240 @@
+/*******************************************************************************
+Raspberry Pi用 I2C バスデーモン raspi_i2cd
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+・I2C バスを初期化したまま保持し、UNIX ドメインソケットで受け付けた要求
+  (命令の並び、libs/i2cd.h)を順に実行して結果を返します。
+・raspi_* は SOFT_I2C_BACKEND=i2cd で起動するとデーモン経由で通信するので、
+  起動ごとの export や i2c_init の待ち時間がなくなります。
+・デーモン自身のバスの方式は SOFT_I2C_I2CD_BACKEND で指定します
+  (未設定時は SOFT_I2C_BACKEND、i2cd の時は既定の方式)。
+・デーモンは起動中ずっとバスをロックするので、デーモン経由でない raspi_* は
+  SOFT_I2C_LOCK_MS の待ち時間の後にエラーになります。
+・クライアントごとの要求数、待ち行列の深さ、応答時間を、切断時と
+  SIGUSR1 受信時に標準エラー出力へ表示します。
+・--stats を付けると、アドレスごとの通信の統計(libs/soft_i2c.c)も
+  SIGUSR1 受信時と終了時に表示します。
+
+コンパイル方法
+    make または gcc -Wall -O1 raspi_i2cd.c soft_i2c.o i2c_sim.o i2c_bench.o -o raspi_i2cd
+
+使い方
+    ./raspi_i2cd &                                  既定のソケットで起動
+    ./raspi_i2cd /tmp/i2c.sock &                    ソケットを指定
+    ./raspi_i2cd --stats &                          通信の統計を記録
+    SOFT_I2C_BACKEND=i2cd ./raspi_bme280            デーモン経由で測定
+    kill -USR1 (デーモンのPID)                       統計を表示
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#define _GNU_SOURCE                         // accept4, SO_PEERCRED用
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "../libs/soft_i2c.h"
+#include "../libs/i2cd.h"
+typedef unsigned char byte;
+
+#define CLIENTS     32                      // 同時に接続できるクライアント数
+
+struct client {
+    int fd;
+    pid_t pid;                              // 接続元のプロセス
+    uint32_t reqs;                          // 要求数
+    uint32_t ops;                           // 命令数
+    uint32_t depth_max;                     // 要求時の待ち行列の深さ(最大)
+    uint64_t depth_sum;
+    uint64_t lat_sum, lat_max;              // 受付から応答までの時間[ns]
+} cl[CLIENTS];
+int clients=0;
+volatile sig_atomic_t stop=0, report=0;
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void on_signal(int sig){
+    if(sig==SIGUSR1) report=1;
+    else stop=1;
+}
+
+void print_client(struct client *c, const char *s){
+    fprintf(stderr,"i2cd: pid %d %s req %u ops %u depth avg %.1f max %u latency avg %.1f max %.1f us\n",
+        (int)c->pid,s,c->reqs,c->ops,
+        c->reqs ? (double)c->depth_sum/c->reqs : 0.,c->depth_max,
+        c->reqs ? c->lat_sum/1000./c->reqs : 0.,c->lat_max/1000.);
+}
+
+int serve(byte *req, int len, byte *res){
+// 要求の命令を順に実行する(エラーの命令以降は実行しない) 戻り値：応答長(-1:要求の形式エラー)
+    int n,pos=1,out=0,fail=0;
+    byte op,adr,txlen,rxlen,*tx;
+    if(len<1) return -1;
+    for(n=req[0];n>0;n--){
+        if(pos+I2CD_OP_HEAD>len) return -1;
+        op=req[pos]; adr=req[pos+1]; txlen=req[pos+2]; rxlen=req[pos+3];
+        tx=&req[pos+I2CD_OP_HEAD];
+        pos+=I2CD_OP_HEAD+txlen;
+        if(pos>len || out+1+rxlen>I2CD_FRAME) return -1;
+        memset(&res[out],0,1+rxlen);
+        if(op>I2CD_DELAY) return -1;
+        if(fail){
+            out+=1+rxlen;
+            continue;
+        }
+        switch(op){
+            case I2CD_CHECK:        res[out]=i2c_check(adr); break;
+            case I2CD_READ:         res[out]=i2c_read(adr,&res[out+1],rxlen); break;
+            case I2CD_WRITE:        res[out]=i2c_write(adr,tx,txlen); break;
+            case I2CD_WRITE_READ:   res[out]=i2c_write_read(adr,tx,txlen,&res[out+1],rxlen); break;
+            case I2CD_DELAY:
+                if(txlen>=2) delay(tx[0]|(tx[1]<<8));
+                res[out]=1;
+                break;
+        }
+        if(!res[out]) fail=1;
+        out+=1+rxlen;
+    }
+    return out;
+}
+
+int main(int argc,char **argv){
+    const char *path=I2CD_SOCK;
+    const char *env=getenv("SOFT_I2C_I2CD_BACKEND");
+    struct sockaddr_un sa;
+    struct pollfd pfd[CLIENTS+1];
+    struct ucred cred;
+    struct stat st;
+    socklen_t cred_len;
+    static byte req[I2CD_FRAME], res[I2CD_FRAME];
+    int lfd,fd,i,j,ready,depth,len,out;
+    int stats=argc;
+    uint64_t t0,lat;
+
+    i2c_stats_opt(&argc,argv);
+    stats = argc<stats;                     // --stats を指定した
+    if( argc >= 2 ) path=argv[1];
+    if( env && env[0] ) setenv("SOFT_I2C_BACKEND",env,1);
+    env=getenv("SOFT_I2C_BACKEND");
+    if( env && !strcmp(env,"i2cd") ) unsetenv("SOFT_I2C_BACKEND");  // デーモン自身はバスを直接使う
+
+    if( lstat(path,&st)==0 && !S_ISSOCK(st.st_mode) ){  // 前回のソケット以外は消さない
+        fprintf(stderr,"ERROR: %s is not a socket\n",path);
+        return -1;
+    }
+    memset(&sa,0,sizeof(sa));
+    sa.sun_family=AF_UNIX;
+    snprintf(sa.sun_path,sizeof(sa.sun_path),"%s",path);
+    lfd=socket(AF_UNIX,SOCK_SEQPACKET|SOCK_CLOEXEC,0);
+    unlink(path);
+    if( lfd<0 || bind(lfd,(struct sockaddr *)&sa,sizeof(sa))<0 || listen(lfd,CLIENTS)<0 ){
+        fprintf(stderr,"ERROR: cannot listen %s\n",path);
+        return -1;
+    }
+    signal(SIGINT,on_signal);
+    signal(SIGTERM,on_signal);
+    signal(SIGUSR1,on_signal);
+    signal(SIGPIPE,SIG_IGN);
+    if( !i2c_init() ){
+        fprintf(stderr,"ERROR: i2c_init\n");
+        unlink(path);
+        return -1;
+    }
+    fprintf(stderr,"i2cd: %s (bus %s, %s)\n",path,i2c_bus_name(),i2c_backend_name());
+
+    while(!stop){
+        if(report){
+            for(i=0;i<clients;i++) print_client(&cl[i],"active");
+            if(stats) i2c_stats_print();
+            report=0;
+        }
+        pfd[0].fd=lfd;
+        pfd[0].events=POLLIN;
+        for(i=0;i<clients;i++){
+            pfd[i+1].fd=cl[i].fd;
+            pfd[i+1].events=POLLIN;
+        }
+        if( poll(pfd,clients+1,-1)<0 ) continue;  // シグナル(EINTR)
+        t0=now_ns();
+
+        /* 要求の受付 (1周で受け付けた要求を順に処理する) */
+        for(ready=0,i=0;i<clients;i++) if(pfd[i+1].revents) ready++;
+        for(depth=ready,i=0;i<clients;i++){
+            if(!pfd[i+1].revents) continue;
+            len=recv(cl[i].fd,req,sizeof(req),0);
+            if(len<=0) continue;            // 切断は後で処理
+            out=serve(req,len,res);
+            if(out<0){
+                fprintf(stderr,"i2cd: pid %d bad request\n",(int)cl[i].pid);
+                shutdown(cl[i].fd,SHUT_RDWR);
+                continue;
+            }
+            send(cl[i].fd,res,out,0);
+            lat=now_ns()-t0;
+            cl[i].reqs++;
+            cl[i].ops+=req[0];
+            cl[i].depth_sum+=depth;
+            if((uint32_t)depth>cl[i].depth_max) cl[i].depth_max=depth;
+            cl[i].lat_sum+=lat;
+            if(lat>cl[i].lat_max) cl[i].lat_max=lat;
+            depth--;
+        }
+
+        /* 切断したクライアント */
+        for(i=0,j=0;i<clients;i++){
+            if( (pfd[i+1].revents & (POLLHUP|POLLERR)) && !(pfd[i+1].revents & POLLIN) ){
+                print_client(&cl[i],"closed");
+                close(cl[i].fd);
+                continue;
+            }
+            if( pfd[i+1].revents & POLLIN ){
+                len=recv(cl[i].fd,req,1,MSG_PEEK|MSG_DONTWAIT);
+                if(len==0){
+                    print_client(&cl[i],"closed");
+                    close(cl[i].fd);
+                    continue;
+                }
+            }
+            cl[j++]=cl[i];
+        }
+        clients=j;
+
+        /* 新しいクライアント */
+        if( pfd[0].revents & POLLIN ){
+            fd=accept4(lfd,NULL,NULL,SOCK_CLOEXEC);
+            if(fd>=0 && clients>=CLIENTS){
+                fprintf(stderr,"i2cd: too many clients\n");
+                close(fd);
+            }else if(fd>=0){
+                memset(&cl[clients],0,sizeof(struct client));
+                cl[clients].fd=fd;
+                cred_len=sizeof(cred);
+                if( getsockopt(fd,SOL_SOCKET,SO_PEERCRED,&cred,&cred_len)==0 ) cl[clients].pid=cred.pid;
+                clients++;
+            }
+        }
+    }
+    for(i=0;i<clients;i++){
+        print_client(&cl[i],"closed");
+        close(cl[i].fd);
+    }
+    i2c_close();
+    close(lfd);
+    unlink(path);
+    return 0;
+}
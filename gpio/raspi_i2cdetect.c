@@ -3,6 +3,18 @@ Raspberry Pi用 I2C i2cdetect
 
 デバイスのI2Cアドレスの検索ツールです。
 I2Cアドレス8～119（0x00～0x77）の応答を確認し、表示します。
+応答したアドレスのうち既知のセンサはチップIDを読んで型番を表示し、
+検索結果を /tmp/soft_i2c_gpio2.inventory (環境変数 SOFT_I2C_INVENTORY)に
+保存します(各 raspi_* は起動時にこれを読んでアドレスを選びます)。
+
+使い方
+    ./raspi_i2cdetect           アドレスを検索
+    ./raspi_i2cdetect -q        高速検索(アドレス間を Repeated START でつなぐ)
+    ./raspi_i2cdetect -l 2,4,5  SDA=GPIO2,4,5 (SCL=GPIO3 共有)を同時に高速検索(mmap)
+    ./raspi_i2cdetect -l 17     SDA=GPIO17 (SCL=GPIO3)を高速検索(SDA が1本なら既定の方式)
+    ./raspi_i2cdetect -c        検索後、応答したアドレスごとに通信速度を自動調整して保存
+                                (以降 soft_i2c は保存したアドレス別の速度で通信します)
+    SOFT_I2C_BACKEND=i2cdev ./raspi_i2cdetect -q    ハードウェアI2Cで検索
 
 本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
 利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
@@ -16,28 +28,170 @@ I2Cアドレス8～119（0x00～0x77）の応答を確認し、表示します
 #include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include "../libs/soft_i2c.h"
-typedef unsigned char byte; 
+typedef unsigned char byte;
+
+#define INIT_RETRY  10                      // i2c_init のリトライ回数
+#define LANE_SCL    3                       // -l のときの共有 SCL
 
-int main(void){
+struct part {                               // チップIDで型番を確認できるセンサ
+    byte adr[4];                            // アドレス(0:終わり)
+    byte reg;                               // チップIDのレジスタ
+    byte id;                                // チップIDの値
+    const char *name;
+} parts[]={
+    {{0x76,0x77},       0xD0, 0x60, "BME280"},
+    {{0x76,0x77},       0xD0, 0x58, "BMP280"},
+    {{0x1D,0x53},       0x00, 0xE5, "ADXL345"},
+    {{0x5D},            0x0F, 0xBD, "LPS25H"},  // 0x5C は AM2320 と共用のため除外
+    {{0x5A,0x5B},       0x20, 0x81, "CCS811"},
+    {{0x38,0x39},       0xFE, 0x53, "STTS751"}, // 製造者ID (0x48～ は ADS1115 と共用のため除外)
+    {{0},0,0,NULL}
+};
+
+int part_reg(byte adr){
+// adr のチップIDのレジスタ(-1:既知のセンサなし)
+    int i,j;
+    for(i=0;parts[i].name;i++) for(j=0;j<4 && parts[i].adr[j];j++){
+        if(parts[i].adr[j]==adr) return parts[i].reg;
+    }
+    return -1;
+}
+
+const char *part_name(byte adr, byte id){
+    int i,j;
+    for(i=0;parts[i].name;i++) for(j=0;j<4 && parts[i].adr[j];j++){
+        if(parts[i].adr[j]==adr && parts[i].id==id) return parts[i].name;
+    }
+    return NULL;
+}
+
+void chip_id(i2c_bus *b, int lanes, byte adr, byte mask, char *s, int size){
+// 既知のセンサのチップIDを読み、型番(不明時はIDの値)を s に書く (例 BME280:D0=60)
+    int reg=part_reg(adr);
+    byte tx, rx[8];
+    const char *name=NULL, *n;
     int i;
+    s[0]='\0';
+    if(reg<0) return;
+    tx=(byte)reg;
+    if(lanes>1){
+        mask &= i2c_write_read_lanes(b,adr,&tx,1,rx,1);
+    }else{
+        mask = i2c_write_read_ex(b,adr,&tx,1,rx,1)==1;
+    }
+    for(i=0;i<lanes;i++){                   // 全レーンが同じ型番のときのみ型番を表示
+        if( !((mask>>i)&1) ) continue;
+        n=part_name(adr,rx[i]);
+        if(name==NULL) name = n ? n : "?";
+        else if(n==NULL || strcmp(name,n)) name="mixed";
+    }
+    for(i=0;i<lanes && !((mask>>i)&1);i++);
+    if(i<lanes) snprintf(s,size,"%s:%02X=%02X",name,reg,rx[i]);
+}
+
+int parse_lanes(const char *s, int *sda){
+    int n=0;
+    char *end;
+    while(n<8){
+        sda[n++]=(int)strtol(s,&end,10);
+        if(end==s) return 0;
+        if(*end!=',') break;
+        s=end+1;
+    }
+    return n;
+}
+
+int main(int argc,char **argv){
+    int i,n;
     byte ret;
+    byte found[128];
+    static char info[128][32];
+    const char *infop[128];
+    int cal=0, quick=0, lanes=1, own=0;    // own:-l で作成したバス
+    int sda[8];
+    uint32_t ns;
+    i2c_bus *b;
+    struct timespec t0,t1;
+
+    i2c_stats_opt(&argc,argv);
+    for(i=1;i<argc;i++){
+        if( !strcmp(argv[i],"-c") ) cal=1;
+        else if( !strcmp(argv[i],"-q") ) quick=1;
+        else if( !strcmp(argv[i],"-l") && i+1<argc ){
+            lanes=parse_lanes(argv[++i],sda);
+            quick=1;
+            own=1;
+        }else lanes=0;
+        if( lanes==0 || (cal && lanes>1) ){
+            fprintf(stderr,"usage: %s [-c] [-q] [-l SDA,SDA,...]\n",argv[0]);
+            return -1;
+        }
+    }
     printf("I2C Detector by W.Kunino\n");
     printf("   https://goo.gl/Dmvh2z\n\n");
 
-    ret=0;
-    while(!ret){
-        ret=i2c_init();
+    if(lanes>1){
+        setenv("SOFT_I2C_BACKEND","mmap",1);    // 複数レーンは GPIO レジスタ直接操作のみ
+        b=i2c_bus_new_lanes(sda,lanes,LANE_SCL);
+        if(b==NULL){
+            fprintf(stderr,"ERROR: -l SDA must be GPIO0-31 (SCL=GPIO%d)\n",LANE_SCL);
+            return -1;
+        }
+    }else if(own){                              // -l の SDA が1本のときは既定の方式で
+        b=i2c_bus_new(sda[0],LANE_SCL);
+        if(b==NULL){
+            fprintf(stderr,"ERROR: -l SDA must be GPIO0-53 (SCL=GPIO%d)\n",LANE_SCL);
+            return -1;
+        }
+    }else b=i2c_bus_default();
+    for(i=INIT_RETRY,ret=0;i>0 && !ret;i--){
+        ret=i2c_init_ex(b);
         if( ret==0 ){
             delay(100);
-            i2c_close();
+            i2c_close_ex(b);
         }
     }
-    for(i=8;i<120;i++){
-        ret=i2c_check(i);
-        if(ret) printf("%02X ",i); else printf("-- ");
+    if(!ret){
+        fprintf(stderr,"ERROR: i2c_init\n");
+        if(own) i2c_bus_free(b);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    if(quick) n=i2c_scan_ex(b,found);
+    else for(n=0,memset(found,0,sizeof(found)),i=I2C_SCAN_FIRST;i<=I2C_SCAN_LAST;i++){
+        found[i]=i2c_check_ex(b,i)!=0;      // 再送回数ではなく有無(レーン1本)
+        n += found[i]!=0;
+    }
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    for(i=I2C_SCAN_FIRST;i<=I2C_SCAN_LAST;i++){
+        if(found[i]) printf("%02X ",i); else printf("-- ");
         if(i%8==7) printf("\n");
     }
-    i2c_close();
+    printf("\n%d found in %.1f ms (%s, bus %s, %s)\n",n,
+        (double)(t1.tv_sec-t0.tv_sec)*1e3 + (double)(t1.tv_nsec-t0.tv_nsec)/1e6,
+        quick ? "quick" : "check",i2c_bus_name_ex(b),i2c_backend_name_ex(b));
+    for(i=0;i<128;i++){
+        infop[i]=NULL;
+        if(!found[i]) continue;
+        chip_id(b,lanes,i,found[i],info[i],sizeof(info[i]));
+        infop[i]=info[i];
+        if(lanes>1) printf("%02X: lanes %02X %s\n",i,found[i],info[i]);
+        else if(info[i][0]) printf("%02X: %s\n",i,info[i]);
+    }
+    if(!i2c_inventory_save_ex(b,found,infop)) fprintf(stderr,"ERROR: inventory not saved\n");
+    if(cal){
+        printf("\nCalibration (bus %s)\n",i2c_bus_name_ex(b));
+        for(i=I2C_SCAN_FIRST;i<=I2C_SCAN_LAST;i++){
+            if(!found[i]) continue;
+            ns=i2c_calibrate_ex(b,i);
+            if(ns) printf("%02X: %6u ns (%.1f kHz)\n",i,ns,1e6/(ns*3.));
+            else printf("%02X: failed\n",i);
+        }
+        if(!i2c_timing_save_ex(b)) fprintf(stderr,"ERROR: timing table not saved\n");
+    }
+    i2c_close_ex(b);
+    if(own) i2c_bus_free(b);
     return 0;
 }
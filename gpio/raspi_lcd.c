@@ -25,6 +25,7 @@ int PORT=-1;						// オプション -rPORT
 
 int main(int argc,char **argv){
 	int num=1; char s[49]; s[0]='\0';
+	i2c_stats_opt(&argc,argv);
 	while(argc >=num+1 && argv[num][0]=='-'){
 		if(argv[num][1]=='i') ERROR_CHECK=0;
 		if(argv[num][1]=='f') LOOP=1;
@@ -11,7 +11,7 @@ Arduino標準ライブラリ「Wire」は使用していない(I2Cの手順の
                                         https://bokunimo.net/raspi/
 *******************************************************************************/
 
-// usage: raspi_lps25h [i2c_address]
+// usage: raspi_lps25h [--bench N] [i2c_address]
 //                      0x5D    
 //                      0x5C    SDO（Pin4 SA0)がLowの時
 
@@ -23,9 +23,7 @@ typedef unsigned char byte;
 byte i2c_address=0x5D;
 
 int _getReg(byte data){
-    i2c_write(i2c_address,&data,1);     // 書込みの実行
-    delay(10);
-    i2c_read(i2c_address,&data,1);      // 読み出し
+    i2c_write_read(i2c_address,&data,1,&data,1);    // 書込みと読み出し
     return (int)data;
 }
 
@@ -59,10 +57,12 @@ float getPress(){
 int main(int argc,char **argv){
     byte config[2];
     
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);
     if( argc == 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
     if( i2c_address>=0x80 ) i2c_address>>=1;
     if( argc < 1 || argc > 2 ){
-        fprintf(stderr,"usage: %s [i2c_address]\n",argv[0]);
+        fprintf(stderr,"usage: %s [--bench N] [i2c_address]\n",argv[0]);
         return -1;
     }
     #ifdef DEBUG
@@ -74,13 +74,16 @@ int main(int argc,char **argv){
     config[0]=0x20;                     // CTRL_REG_1
     config[1]=0x80;                     // PD=1 , One Shot Mode
     i2c_write(i2c_address,config,2);    // 書込みの実行
-    config[0]=0x21;                     // CTRL_REG_2
-    config[1]=0x01;                     // One Shot
-    i2c_write(i2c_address,config,2);    // 書込みの実行
-    delay(20);
+    do{
+        i2c_bench_begin();
+        config[0]=0x21;                 // CTRL_REG_2
+        config[1]=0x01;                 // One Shot
+        i2c_write(i2c_address,config,2);    // 書込みの実行
+        delay(20);
 
-    printf("%3.2f ",getTemp());
-    printf("%4.2f\n",getPress());
+        printf("%3.2f ",getTemp());
+        printf("%4.2f\n",getPress());
+    }while(i2c_bench_end());
     
     config[0]=0x20;                     // CTRL_REG_1
     config[1]=0x00;                     // PD=0
@@ -5,21 +5,23 @@ Raspberry Pi用 UART 二酸化炭素CO2 ガスセンサ Winsen MH-Z19 for Raspbe
 利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
 
 UART接続のWinsen MH-Z19センサから測定値を取得する
+--bench N を付けると N回続けて測定し、測定速度と所要時間の内訳を表示する
+(集計は libs/i2c_bench.c、UART の通信時間は内訳の other に含まれる)
+
+コンパイル方法
+    make または gcc -Wall -O1 raspi_mhz19.c uart.o i2c_bench.o -o raspi_mhz19
 
                                        Copyright (c) 2015-2017 Wataru KUNINO
                                        https://bokunimo.net/raspi/
 ***************************************************************************************/
 
 #include <stdio.h>                                  // 標準入出力用
-#include <unistd.h>                                 // usleep用
 #include "../libs/uart.h"
+#include "../libs/i2c_bench.h"                      // --bench N 用
 //  #define DEBUG
 
 void delay(int i){
-    while(i){
-        usleep(1000);
-        i--;
-    }
+    i2c_bench_sleep(i);                             // --bench の内訳で sleep に数える
 }
 
 int getCo2(char *port){
@@ -36,7 +38,7 @@ int getCo2(char *port){
     putb_serial_port(com,9);
     i=0;
     while(getch_serial_port() != 0xFF){
-        delay(1);
+        i2c_bench_wait(1);                          // 応答待ち
         i++; 
         if(i>1000){
 			fprintf(stderr,"Timed Out (%d)\n",i);
@@ -69,14 +71,18 @@ int getCo2(char *port){
 int main(int argc, char *argv[]){
 	int co2;
 	
-    if(argc==2) co2=getCo2(argv[1]);
-    else co2=getCo2("");
-    if(co2<0){
-        fprintf(stderr,"Usage : %s (port; eg:/dev/ttyUSB0)\n",argv[0]);
-        printf("-1\n");
-        return -1;
-    }
-    printf("%d\n",co2);
+    i2c_bench_opt(&argc,argv);
+    do{
+        i2c_bench_begin();
+        if(argc==2) co2=getCo2(argv[1]);
+        else co2=getCo2("");
+        if(co2<0){
+            fprintf(stderr,"Usage : %s [--bench N] (port; eg:/dev/ttyUSB0)\n",argv[0]);
+            printf("-1\n");
+            return -1;
+        }
+        printf("%d\n",co2);
+    }while(i2c_bench_end());
     return 0;
 }
 
@@ -25,9 +25,7 @@ byte i2c_address=0x48;				// S-5851A の I2C アドレス
 
 uint16_t _getReg(byte data){
 	byte rx[2];
-    i2c_write(i2c_address,&data,1);	// 書込みの実行
-    delay(10);						// 6.5ms以上
-    i2c_read(i2c_address,rx,2);		// 読み出し
+    i2c_write_read(i2c_address,&data,1,rx,2);	// 書込みと読み出し
     return (((uint16_t)rx[0])<<8)|((uint16_t)rx[1]);
 }
 
@@ -38,6 +36,7 @@ float getTemp(){
 }
 
 int main(int argc,char **argv){
+    i2c_stats_opt(&argc,argv);
     if( argc >= 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
     if(i2c_address>=0x80) i2c_address>>=1;
     if( argc < 1 || argc > 2 ){
@@ -10,7 +10,7 @@ I2C接続のセンサから測定値を取得する
                                         https://bokunimo.net/raspi/
 *******************************************************************************/
 
-// usage: raspi_si7021 [i2c_address]
+// usage: raspi_si7021 [--bench N] [i2c_address]
 //                      0x40    
 
 #include <stdio.h>
@@ -26,8 +26,7 @@ uint8_t _si7021_getId(){
     uint8_t tx[2]={0xFC,0xC9};
     uint8_t rx;
     
-    i2c_write(i2c_address,tx,2);     // 書込みの実行
-    i2c_read(i2c_address,&rx,1);     // 読み出し
+    i2c_write_read(i2c_address,tx,2,&rx,1);     // 書込みと読み出し
     #ifdef DEBUG
         printf("Device ID   =0x%02X\n",rx);
     #endif
@@ -37,8 +36,7 @@ uint8_t _si7021_getId(){
 uint8_t _si7021_getUserReg(){
     uint8_t tx=0xE7;
     uint8_t rx;
-    i2c_write(i2c_address,&tx,1);     // 書込みの実行
-    i2c_read(i2c_address,&rx,1);      // 読み出し
+    i2c_write_read(i2c_address,&tx,1,&rx,1);    // 書込みと読み出し
     #ifdef DEBUG
         printf("User Reg    =0x%02X\n",rx);
     #endif
@@ -99,10 +97,12 @@ float getHum(){
 }
 
 int main(int argc,char **argv){
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);
     if( argc == 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
     if( i2c_address>=0x80 ) i2c_address>>=1;
     if( argc < 1 || argc > 2 ){
-        fprintf(stderr,"usage: %s [i2c_address]\n",argv[0]);
+        fprintf(stderr,"usage: %s [--bench N] [i2c_address]\n",argv[0]);
         return -1;
     }
     #ifdef DEBUG
@@ -110,7 +110,10 @@ int main(int argc,char **argv){
     #endif
 
     setup();
-    printf("%3.2f %4.2f\n",getTemp(),getHum());
+    do{
+        i2c_bench_begin();
+        printf("%3.2f %4.2f\n",getTemp(),getHum());
+    }while(i2c_bench_end());
     i2c_close();
     return 0;
 }
@@ -32,13 +32,11 @@ int i2c_temp(byte i2c_address){
             
     i2c_write(i2c_address,config,2);    // レジスタ 0x03設定
     delay(120);                         // 測定待ち 112ms以上
-    data=0x00;
-    i2c_write(i2c_address,&data,1);     // レジスタ 0x00(温度上位桁)を指定
-    i2c_read(i2c_address,&data,1);      // 読み出し
+    data=0x00;                          // レジスタ 0x00(温度上位桁)を指定
+    i2c_write_read(i2c_address,&data,1,&data,1);    // 読み出し
     temp = ((int)((signed char)data))*100;
-    data=0x02;
-    i2c_write(i2c_address,&data,1);     // レジスタ 0x02(温度下位桁)を指定
-    i2c_read(i2c_address,&data,1);      // 読み出し
+    data=0x02;                          // レジスタ 0x02(温度下位桁)を指定
+    i2c_write_read(i2c_address,&data,1,&data,1);    // 読み出し
     temp += ((int)(data>>4))*100/16;
     config[1]=0b11001100;
     i2c_write(i2c_address,config,2);
@@ -46,14 +44,19 @@ int i2c_temp(byte i2c_address){
 }
 
 int main(int argc,char **argv){
+    i2c_stats_opt(&argc,argv);
+    i2c_bench_opt(&argc,argv);
     if( argc == 2 ) i2c_address=(byte)strtol(argv[1],NULL,16);
     if( i2c_address>=0x80 ) i2c_address>>=1;
     if( argc < 1 || argc > 2 ){
-        fprintf(stderr,"usage: %s [i2c_address]\n",argv[0]);
+        fprintf(stderr,"usage: %s [--bench N] [i2c_address]\n",argv[0]);
         return -1;
     }
     i2c_init();
-    printf("%3.2f\n",((double)i2c_temp(i2c_address))/100.);
+    do{
+        i2c_bench_begin();
+        printf("%3.2f\n",((double)i2c_temp(i2c_address))/100.);
+    }while(i2c_bench_end());
     i2c_close();
     return 0;
 }
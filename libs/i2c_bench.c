@@ -0,0 +1,136 @@
+/*******************************************************************************
+Raspberry Pi用 センサの測定速度の集計 i2c_bench (--bench N)
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+i2c_bench_opt で引数の --bench N を取り除き、1回分の測定を
+do{ i2c_bench_begin(); ... }while(i2c_bench_end()); で囲んで N 回繰り返す。
+1回ごとの所要時間を、バスの通信(成功した i2c_check/read/write/write_read)、
+delay() の固定の待ち時間、変換待ち(i2c_bench_wait、変換中の NACK と
+クロックストレッチ)、その他(計算、表示、UART など)に分けて集計し、最後に
+標準エラー出力へ表示する。--bench が無いときは1回だけ実行し、集計しない。
+集計はプロセスに1つで、1つのスレッドから使う。
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "i2c_bench.h"
+
+#define BENCH_MAX   1000000             // 繰返し回数の上限
+
+static int _bench_n=0;                  // 繰返し回数 (0:--bench なし)
+static int _bench_i=0;                  // 終えた回数
+static uint64_t _bench_start, _bench_t0;    // 最初と今回の測定の開始時刻[ns]
+static uint64_t *_bench_lat=NULL;       // 各回の所要時間[ns]
+static uint64_t _bench_ns[3];           // 内訳ごとの時間の合計[ns]
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void _sleep_ms(int ms, int kind){
+    struct timespec ts;
+    uint64_t t0=_now_ns(), t=t0+(uint64_t)ms*1000000ull;
+    if(ms<=0) return;
+    ts.tv_sec  = t / 1000000000ull;
+    ts.tv_nsec = t % 1000000000ull;
+    while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL)==EINTR) ;
+    if(_bench_n) _bench_ns[kind]+=_now_ns()-t0;
+}
+
+static int _bench_cmp(const void *a, const void *b){
+    uint64_t x=*(const uint64_t *)a, y=*(const uint64_t *)b;
+    return (x>y)-(x<y);
+}
+
+int i2c_bench_opt(int *argc, char **argv){
+// 引数から --bench N を取り除き、測定の繰返しを有効にする 戻り値：N (0:指定なし)
+    int i,j,n=0;
+    for(i=1,j=1;i<*argc;i++){
+        if(!strcmp(argv[i],"--bench") && i+1<*argc) n=atoi(argv[++i]);
+        else argv[j++]=argv[i];
+    }
+    argv[j]=NULL;
+    *argc=j;
+    if(n<=0) return 0;
+    if(n>BENCH_MAX) n=BENCH_MAX;
+    _bench_lat=(uint64_t *)malloc(n*sizeof(uint64_t));
+    if(_bench_lat==NULL){
+        fprintf(stderr,"ERROR: i2c_bench / malloc Error\n");
+        return 0;
+    }
+    _bench_n=n;
+    _bench_i=0;
+    return n;
+}
+
+void i2c_bench_begin(void){
+    if(!_bench_n) return;
+    _bench_t0=_now_ns();
+    if(_bench_i==0){                    // 初期化までの通信と待ち時間は含めない
+        _bench_start=_bench_t0;
+        memset(_bench_ns,0,sizeof(_bench_ns));
+    }
+}
+
+int i2c_bench_end(void){
+// 戻り値：1 の時は次の測定を行う (N 回目の後に結果を表示して 0)
+    uint64_t t,other;
+    double ms[4];
+    int i;
+    if(!_bench_n) return 0;
+    t=_now_ns();
+    _bench_lat[_bench_i++]=t-_bench_t0;
+    if(_bench_i<_bench_n) return 1;
+    t-=_bench_start;
+    qsort(_bench_lat,_bench_n,sizeof(uint64_t),_bench_cmp);
+    other=_bench_ns[I2C_BENCH_BUS]+_bench_ns[I2C_BENCH_SLEEP]+_bench_ns[I2C_BENCH_WAIT];
+    other = t>other ? t-other : 0;
+    for(i=0;i<3;i++) ms[i]=_bench_ns[i]/1e6/_bench_n;
+    ms[3]=other/1e6/_bench_n;
+    fprintf(stderr,"bench: %d samples in %.3f s, %.2f samples/sec\n",_bench_n,t/1e9,_bench_n*1e9/t);
+    fprintf(stderr,"bench: latency p50 %.3f p99 %.3f max %.3f ms\n",
+        _bench_lat[(_bench_n-1)*50/100]/1e6,_bench_lat[(_bench_n-1)*99/100]/1e6,_bench_lat[_bench_n-1]/1e6);
+    fprintf(stderr,"bench: per sample bus %.3f ms (%.0f%%) sleep %.3f ms (%.0f%%) wait %.3f ms (%.0f%%) other %.3f ms (%.0f%%)\n",
+        ms[0],_bench_ns[I2C_BENCH_BUS]*100./t,ms[1],_bench_ns[I2C_BENCH_SLEEP]*100./t,
+        ms[2],_bench_ns[I2C_BENCH_WAIT]*100./t,ms[3],other*100./t);
+    free(_bench_lat);
+    _bench_lat=NULL;
+    _bench_n=0;
+    return 0;
+}
+
+void i2c_bench_sleep(int ms){
+// 固定の待ち時間 (内訳の sleep に数える、I2C を使わないツールの delay 用)
+    _sleep_ms(ms,I2C_BENCH_SLEEP);
+}
+
+void i2c_bench_wait(int ms){
+// 変換の完了を待つ delay (内訳の wait に数える)
+    _sleep_ms(ms,I2C_BENCH_WAIT);
+}
+
+int i2c_bench_active(void){
+// 戻り値：1 の時は --bench の集計中
+    return _bench_n!=0;
+}
+
+void i2c_bench_add(int kind, uint64_t ns){
+// 時間 ns を内訳 kind (I2C_BENCH_*) に数える
+    if(_bench_n && kind>=0 && kind<3) _bench_ns[kind]+=ns;
+}
+
+uint64_t i2c_bench_total(int kind){
+// 内訳 kind のこれまでの合計[ns]
+    return (kind>=0 && kind<3) ? _bench_ns[kind] : 0;
+}
@@ -0,0 +1,28 @@
+/*******************************************************************************
+Raspberry Pi用 センサの測定速度の集計 i2c_bench (--bench N)
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+各 raspi_* は1回分の測定を do{ i2c_bench_begin(); ... }while(i2c_bench_end());
+で囲んで N 回繰り返す。soft_i2c は通信と待ち時間を i2c_bench_add で内訳に数える。
+I2C を使わないツール(raspi_mhz19 等)も i2c_bench.o だけで利用できる。
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#include <stdint.h>
+
+#define I2C_BENCH_BUS       0                       // 内訳の種類：成功した通信
+#define I2C_BENCH_SLEEP     1                       // delay() の固定の待ち時間
+#define I2C_BENCH_WAIT      2                       // 変換待ち(状態の確認、NACK、ストレッチ)
+
+int i2c_bench_opt(int *argc, char **argv);
+void i2c_bench_begin(void);
+int i2c_bench_end(void);
+void i2c_bench_sleep(int ms);
+void i2c_bench_wait(int ms);
+int i2c_bench_active(void);
+void i2c_bench_add(int kind, uint64_t ns);
+uint64_t i2c_bench_total(int kind);
@@ -0,0 +1,774 @@
+/*******************************************************************************
+Raspberry Pi用 ソフトウェアI2C soft_i2c の模擬バス i2c_sim
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+Raspberry Pi やセンサがなくても raspi_* を動作させるためのデバイスモデルです。
+SOFT_I2C_BACKEND=sim で soft_i2c の通信がここに渡されます。各モデルはデータ
+シートのレジスタ配置と変換時間を持ち、測定値は固定値(常に同じ結果)です。
+模擬バスはプロセスに1つです。sim 方式のバスを複数開いても同じデバイスの集まり
+を共有し(最後の i2c_sim_close で閉じる)、1つのスレッドからのみ使用します。
+
+環境変数 SOFT_I2C_SIM (カンマ区切り、未設定時は下表の既定のアドレスの全デバイス)
+    デバイス名[@アドレス][/ストレッチ]  デバイスを置く(例 bme280@77、ccs811/500)
+                            ストレッチは受信時に SCL を L に保持する時間[us]
+    latency=倍率            変換時間の倍率 (既定 1、0:変換待ちなし)
+    nack=確率[%]            アドレスの NACK を起こす確率
+    flip=確率[%]            受信データの1ビットを反転する確率(バイトごと)
+    stuck=確率[%]           通信後に SDA を L に固着させる確率 (i2c_recover で復旧)
+    seed=値                 乱数の初期値 (既定 1、同じ値なら同じ故障が起きる)
+    verbose                 i2c_close でデバイスごとの通信回数と液晶の表示を出力
+
+    デバイス名  既定のアドレス  変換時間    備考
+    bme280      76              9ms         osrs の設定による、status の measuring
+    adxl345     1D              10ms        BW_RATE の設定による
+    ccs811      5A              1s          MEAS_MODE の設定による、受信時にストレッチ
+    si7021      40              12ms        No Hold は NACK、Hold はストレッチで待つ
+    hdc1000     41              6.5ms       変換中の受信は NACK (0x40 は si7021)
+    lps25h      5D              10ms        ONE_SHOT
+    stts751     39              84ms        分解能の設定による
+    am2320      5C              1.5ms       休止中は NACK(起動のみ)
+    ads1115     48              8ms         DR の設定による、AIN0～3 は 0.5～2.0V
+    lcd         3E              1ms         ST7032、実行中の命令の書込みは無視
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "i2c_sim.h"
+
+#define SIM_DEVS    16                  // 置けるデバイスの最大数
+#define SIM_DEFAULT "bme280,adxl345,ccs811,si7021,hdc1000,lps25h,stts751,am2320,ads1115,lcd"
+
+typedef struct sim_dev sim_dev;
+typedef struct {
+    const char *name;
+    uint8_t adr;                        // 既定のアドレス
+    uint32_t stretch_us;                // 既定のクロックストレッチ[us]
+    void (*reset)(sim_dev *d);
+    int (*write)(sim_dev *d, const uint8_t *tx, int len);   // 戻り値：ACK したバイト数 (-1:アドレスに NACK)
+    int (*read)(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us);   // 戻り値：0 (-1:アドレスに NACK)
+    void (*done)(sim_dev *d);           // 変換の完了(測定値をレジスタへ)
+} sim_model;
+
+struct sim_dev {
+    const sim_model *m;
+    uint8_t adr;
+    uint32_t stretch_us;
+    uint8_t reg[256];                   // レジスタ (液晶は DDRAM)
+    uint8_t buf[16];                    // 応答の組立て用
+    uint8_t ptr;                        // レジスタ番号(アドレスカウンタ)
+    uint8_t cmd;                        // 受信で応答するコマンド
+    uint8_t awake;                      // AM2320 の起動中
+    uint64_t ready;                     // 変換完了の時刻[ns] (0:変換なし)
+    uint32_t samples;                   // 変換の回数
+    uint32_t xfer, nack, fault;         // 通信回数、NACK、故障の注入回数
+};
+
+static sim_dev _dev[SIM_DEVS];
+static int _devs=0;
+static int _opened=0;                  // i2c_sim_open の回数 (排他なし、1スレッド用)
+static double _latency=1.;
+static double _nack_p=0., _flip_p=0., _stuck_p=0.;
+static uint32_t _rand_x=1;
+static int _stuck=0;
+static int _verbose=0;
+
+static uint64_t _now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t _rand(void){            // xorshift32 (seed で再現できる)
+    _rand_x ^= _rand_x<<13;
+    _rand_x ^= _rand_x>>17;
+    _rand_x ^= _rand_x<<5;
+    return _rand_x;
+}
+
+static int _chance(double pct){
+    return pct>0. && (_rand()%1000000) < (uint32_t)(pct*10000.);
+}
+
+static void _start(sim_dev *d, uint32_t us){
+// 変換を開始する (us: データシートの変換時間)
+    d->ready = _now() + (uint64_t)(us*1000.*_latency) + 1;
+}
+
+static int _busy(sim_dev *d){
+// 完了した変換を反映する 戻り値：1 変換中
+    if(!d->ready) return 0;
+    if(_now()<d->ready) return 1;
+    d->ready=0;
+    d->samples++;
+    if(d->m->done) d->m->done(d);
+    return 0;
+}
+
+static uint32_t _remain_us(sim_dev *d){
+    uint64_t now=_now();
+    return d->ready>now ? (uint32_t)((d->ready-now+999)/1000) : 0;
+}
+
+static int _reg_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+// 自動インクリメントで読み出す
+    int i;
+    _busy(d);
+    for(i=0;i<len;i++) rx[i]=d->reg[d->ptr++];
+    return 0;
+}
+
+static void _put16(uint8_t *p, uint16_t v){     // ビッグエンディアン
+    p[0]=(uint8_t)(v>>8);
+    p[1]=(uint8_t)v;
+}
+
+static void _put16le(uint8_t *p, uint16_t v){
+    p[0]=(uint8_t)v;
+    p[1]=(uint8_t)(v>>8);
+}
+
+/* BME280 (データシートの補償式の例の値: 約25.1℃ 1006.5hPa) */
+static const uint16_t _bme280_cal[12]={27504,26435,(uint16_t)-1000,36477,(uint16_t)-10685,3024,
+                                       2855,140,(uint16_t)-7,15500,(uint16_t)-14600,6000};
+
+static void _bme280_reset(sim_dev *d){
+    int i;
+    memset(d->reg,0,sizeof(d->reg));
+    for(i=0;i<12;i++) _put16le(&d->reg[0x88+i*2],_bme280_cal[i]);
+    d->reg[0xA1]=75;                    // dig_H1
+    _put16le(&d->reg[0xE1],362);        // dig_H2
+    d->reg[0xE3]=0;                     // dig_H3
+    d->reg[0xE4]=0x13;                  // dig_H4=313, dig_H5=50
+    d->reg[0xE5]=0x29;
+    d->reg[0xE6]=0x03;
+    d->reg[0xE7]=30;                    // dig_H6
+    d->reg[0xD0]=0x60;
+    d->reg[0xF7]=0x80; d->reg[0xFA]=0x80; d->reg[0xFD]=0x80;
+}
+
+static void _bme280_done(sim_dev *d){
+    const uint32_t adc[2]={415148,519888};  // 気圧, 温度 (20ビット)
+    int i;
+    for(i=0;i<2;i++){
+        d->reg[0xF7+i*3]=(uint8_t)(adc[i]>>12);
+        d->reg[0xF8+i*3]=(uint8_t)(adc[i]>>4);
+        d->reg[0xF9+i*3]=(uint8_t)((adc[i]&0x0F)<<4);
+    }
+    _put16(&d->reg[0xFD],29500);        // 湿度 (16ビット)
+    if((d->reg[0xF4]&0x03)!=0x03) d->reg[0xF4]&=~0x03;     // forced は完了でスリープ
+}
+
+static int _bme280_write(sim_dev *d, const uint8_t *tx, int len){
+// レジスタ番号とデータの組を繰り返す
+    int i,j,us;
+    uint8_t v,osrs[3];
+    for(i=0;i<len;i++){
+        if(i%2==0){
+            d->ptr=tx[i];
+            continue;
+        }
+        v=tx[i];
+        if(d->ptr==0xE0 && v==0xB6) _bme280_reset(d);
+        if(d->ptr==0xF2 || d->ptr==0xF5) d->reg[d->ptr]=v;
+        if(d->ptr==0xF4){               // ctrl_meas (測定時間は t_measure,typ)
+            d->reg[0xF4]=v;
+            osrs[0]=v>>5; osrs[1]=(v>>2)&7; osrs[2]=d->reg[0xF2]&7;
+            for(us=1000,j=0;j<3;j++) if(osrs[j]) us += 2000*(1<<((osrs[j]>5 ? 5 : osrs[j])-1)) + (j ? 500 : 0);
+            if(v&0x03) _start(d,us);
+        }
+    }
+    return len;
+}
+
+static int _bme280_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    d->reg[0xF3] = _busy(d) ? 0x08 : 0x00;     // measuring
+    return _reg_read(d,rx,len,stretch_us);
+}
+
+/* ADXL345 (静止、Z軸に1g) */
+static void _adxl345_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    d->reg[0x00]=0xE5;                  // DEVID
+    d->reg[0x2C]=0x0A;                  // BW_RATE 100Hz
+    d->reg[0x30]=0x02;                  // INT_SOURCE
+}
+
+static void _adxl345_done(sim_dev *d){
+    uint8_t fmt=d->reg[0x31];
+    int z = (fmt&0x08) ? 256 : 256>>(fmt&0x03);    // FULL_RES は 3.9mg/LSB
+    memset(&d->reg[0x32],0,4);
+    _put16le(&d->reg[0x36],(uint16_t)z);
+    d->reg[0x30] |= 0x80;               // DATA_READY
+}
+
+static int _adxl345_write(sim_dev *d, const uint8_t *tx, int len){
+    int i;
+    uint8_t r;
+    if(len) d->ptr=tx[0];
+    for(i=1;i<len;i++){
+        r=d->ptr++;
+        if(r==0x00 || r==0x30 || (r>=0x32 && r<=0x39)) continue;  // 読出し専用
+        d->reg[r]=tx[i];
+        if(r==0x2D && (tx[i]&0x08)) _start(d,3200000u>>(d->reg[0x2C]&0x0F));  // 1/出力データレート
+    }
+    return len;
+}
+
+static int _adxl345_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    uint8_t r=d->ptr;
+    _reg_read(d,rx,len,stretch_us);
+    if(r<=0x37 && r+len>0x32) d->reg[0x30] &= ~0x80;    // データの読出しで解除
+    return 0;
+}
+
+/* CCS811 (メールボックス形式、APP_START 後に MEAS_MODE で周期測定) */
+static void _ccs811_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    memset(d->buf,0,sizeof(d->buf));
+    d->reg[0x00]=0x10;                  // STATUS APP_VALID (ブートモード)
+    d->reg[0x20]=0x81;                  // HW_ID
+    d->reg[0x21]=0x12;                  // HW_VERSION
+    d->ptr=0x00;
+}
+
+static const uint32_t _ccs811_period_us[5]={0,1000000,10000000,60000000,250000};
+
+static void _ccs811_done(sim_dev *d){
+    uint8_t mode=(d->reg[0x01]>>4)&7;
+    _put16(&d->buf[0],(uint16_t)(400+(d->samples%8)*5));  // eCO2[ppm]
+    _put16(&d->buf[2],(uint16_t)((d->samples%8)*2));      // TVOC[ppb]
+    d->reg[0x00] |= 0x08;               // DATA_READY
+    d->buf[4]=d->reg[0x00];
+    d->buf[5]=0;
+    _put16(&d->buf[6],(uint16_t)((10<<10)|500));          // 電流 10uA, ADC
+    if(mode>=1 && mode<=4) _start(d,_ccs811_period_us[mode]);
+}
+
+static int _ccs811_write(sim_dev *d, const uint8_t *tx, int len){
+    uint8_t mode;
+    if(len==0) return 0;
+    d->ptr=tx[0];
+    switch(tx[0]){
+        case 0xF4:                      // APP_START
+            d->reg[0x00] |= 0x80;       // FW_MODE
+            break;
+        case 0x01:                      // MEAS_MODE
+            if(len<2) break;
+            if(!(d->reg[0x00]&0x80)){   // ブートモードでは書けない
+                d->reg[0x00] |= 0x01;
+                d->reg[0xE0] = 0x01;    // WRITE_REG_INVALID
+                break;
+            }
+            d->reg[0x01]=tx[1]&0x7C;
+            mode=(tx[1]>>4)&7;
+            d->ready=0;
+            if(mode>=1 && mode<=4) _start(d,_ccs811_period_us[mode]);
+            break;
+        case 0xFF:                      // SW_RESET
+            if(len==5 && tx[1]==0x11 && tx[2]==0xE5 && tx[3]==0x72 && tx[4]==0x8A){
+                _ccs811_reset(d);
+                d->ready=0;
+            }
+            break;
+    }
+    return len;
+}
+
+static int _ccs811_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    int i;
+    _busy(d);
+    for(i=0;i<len;i++){
+        if(d->ptr==0x02) rx[i] = i<8 ? d->buf[i] : 0;   // ALG_RESULT_DATA
+        else rx[i] = i==0 ? d->reg[d->ptr] : 0;
+    }
+    if(d->ptr==0x02) d->reg[0x00] &= ~0x08;
+    if(d->ptr==0xE0){                   // ERROR_ID は読出しで解除
+        d->reg[0xE0]=0;
+        d->reg[0x00] &= ~0x01;
+    }
+    return 0;
+}
+
+/* Si7021 (25.0℃ 50.0%) */
+static uint8_t _crc8(const uint8_t *p, int len){
+    uint8_t crc=0;
+    int i,j;
+    for(i=0;i<len;i++){
+        crc ^= p[i];
+        for(j=0;j<8;j++) crc = (crc&0x80) ? (uint8_t)((crc<<1)^0x31) : (uint8_t)(crc<<1);
+    }
+    return crc;
+}
+
+static void _si7021_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    d->reg[0xE7]=0x3A;                  // ユーザレジスタ
+    d->cmd=0;
+}
+
+static int _si7021_write(sim_dev *d, const uint8_t *tx, int len){
+    if(len==0) return 0;
+    d->cmd=tx[0];
+    switch(tx[0]){
+        case 0xE6: if(len>=2) d->reg[0xE7]=(tx[1]&0xC5)|0x3A; break;  // 予約ビットは保持
+        case 0xFE: _si7021_reset(d); break;
+        case 0xE5: case 0xF5: _start(d,12000); break;     // 湿度(温度も測定)
+        case 0xE3: case 0xF3: _start(d,10800); break;     // 温度
+    }
+    return len;
+}
+
+static int _si7021_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    uint16_t v=0;
+    int n=3,i;
+    if(_busy(d)){
+        if(d->cmd==0xF5 || d->cmd==0xF3) return -1;    // No Hold Master は変換中 NACK
+        *stretch_us += _remain_us(d);   // Hold Master は完了までストレッチ
+        d->ready=_now();
+        _busy(d);
+    }
+    switch(d->cmd){
+        case 0xE5: case 0xF5: v=29360; break;   // (50+6)*65536/125
+        case 0xE3: case 0xF3: case 0xE0: v=26797; break;   // (25+46.85)*65536/175.72
+        case 0xE7: n=1; d->buf[0]=d->reg[0xE7]; break;
+        case 0xFA: memset(d->buf,0,8); n=8; break;         // 電子ID 前半
+        case 0xFC:                      // 電子ID 後半 SNB_3=0x15 (Si7021)
+            d->buf[0]=0x15; d->buf[1]=0xFF; d->buf[2]=_crc8(d->buf,2);
+            d->buf[3]=0xFF; d->buf[4]=0xFF; d->buf[5]=_crc8(&d->buf[3],2);
+            n=6;
+            break;
+        default: n=0;
+    }
+    if(n==3){
+        _put16(d->buf,v);
+        d->buf[2]=_crc8(d->buf,2);
+        if(d->cmd==0xE0) n=2;
+    }
+    for(i=0;i<len;i++) rx[i] = i<n ? d->buf[i] : 0xFF;
+    return 0;
+}
+
+/* HDC1000 (25.0℃ 50.0%) */
+static void _hdc1000_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    _put16(&d->reg[0x02*2],0x1000);     // 設定 (16ビットのレジスタ n は reg[n*2])
+    d->ptr=0;
+}
+
+static void _hdc1000_done(sim_dev *d){
+    _put16(&d->reg[0x00],25817);        // (25+40)/165*65536
+    _put16(&d->reg[0x02],32768);
+}
+
+static uint16_t _hdc1000_reg(sim_dev *d, uint8_t r){
+    switch(r){
+        case 0x00: case 0x01: case 0x02: return (uint16_t)((d->reg[r*2]<<8)|d->reg[r*2+1]);
+        case 0xFE: return 0x5449;       // Manufacturer ID
+        case 0xFF: return 0x1000;       // Device ID
+    }
+    return 0;
+}
+
+static int _hdc1000_write(sim_dev *d, const uint8_t *tx, int len){
+    uint16_t cfg;
+    if(len==0) return 0;
+    d->ptr=tx[0];
+    if(tx[0]==0x02 && len>=3){
+        cfg=(uint16_t)((tx[1]<<8)|tx[2]);
+        if(cfg&0x8000) _hdc1000_reset(d);
+        else _put16(&d->reg[0x04],cfg&0x1F00);
+    }
+    if(tx[0]<=0x01 && len==1){          // ポインタ 0x00/0x01 の書込みで変換を開始
+        cfg=_hdc1000_reg(d,0x02);
+        _start(d,(tx[0]==0x00 && (cfg&0x1000)) ? 13000 : 6500);
+    }
+    return len;
+}
+
+static int _hdc1000_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    uint8_t r=d->ptr;
+    int i;
+    if(_busy(d)) return -1;             // 変換中は NACK
+    for(i=0;i<len;i++){
+        if(i==2 && r==0x00 && (_hdc1000_reg(d,0x02)&0x1000)) r=0x01;  // 温度と湿度を続けて
+        rx[i]=(uint8_t)(_hdc1000_reg(d,r)>>((i&1) ? 0 : 8));
+    }
+    return 0;
+}
+
+/* LPS25H (25.0℃ 1013.25hPa) */
+static void _lps25h_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    d->reg[0x0F]=0xBD;                  // WHO_AM_I
+}
+
+static void _lps25h_done(sim_dev *d){
+    d->reg[0x28]=0x00; d->reg[0x29]=0x54; d->reg[0x2A]=0x3F;   // 1013.25*4096
+    _put16le(&d->reg[0x2B],(uint16_t)-8400);                  // (25-42.5)*480
+    d->reg[0x27]=0x03;                  // T_DA, P_DA
+    d->reg[0x21]&=~0x01;                // ONE_SHOT は完了で解除
+}
+
+static int _lps25h_write(sim_dev *d, const uint8_t *tx, int len){
+    int i;
+    uint8_t r;
+    if(len==0) return 0;
+    d->ptr=tx[0]&0x7F;
+    d->cmd=tx[0]&0x80;                  // 自動インクリメント
+    for(i=1;i<len;i++){
+        r=d->ptr;
+        if(d->cmd) d->ptr++;
+        if(r!=0x20 && r!=0x21) continue;
+        d->reg[r]=tx[i];
+        if(r==0x21 && (tx[i]&0x01) && (d->reg[0x20]&0x80)) _start(d,10000);
+    }
+    return len;
+}
+
+static int _lps25h_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    int i;
+    _busy(d);
+    for(i=0;i<len;i++){
+        rx[i]=d->reg[d->ptr];
+        if(d->ptr>=0x28 && d->ptr<=0x2C) d->reg[0x27] &= ~(d->ptr>=0x2B ? 0x01 : 0x02);
+        if(d->cmd) d->ptr++;
+    }
+    return 0;
+}
+
+/* STTS751 (25.5℃) */
+static void _stts751_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    d->reg[0x04]=0x04;                  // 変換レート 1Hz
+    d->reg[0xFD]=0x00;                  // Product ID (STTS751-0)
+    d->reg[0xFE]=0x53;                  // Manufacturer ID
+    d->reg[0xFF]=0x01;
+}
+
+static void _stts751_done(sim_dev *d){
+    d->reg[0x00]=25;
+    d->reg[0x02]=0x80;
+}
+
+static int _stts751_write(sim_dev *d, const uint8_t *tx, int len){
+    static const uint32_t conv_us[4]={21000,42000,84000,10500};  // 分解能 10, 11, 12, 9ビット
+    if(len==0) return 0;
+    d->ptr=tx[0];
+    if(len<2) return len;
+    if(tx[0]==0x03){
+        d->reg[0x03]=tx[1];
+        if(!(tx[1]&0x40)) _start(d,conv_us[(tx[1]>>2)&3]);     // RUN
+    }
+    if(tx[0]==0x0F) _start(d,conv_us[(d->reg[0x03]>>2)&3]);   // One-shot
+    if(tx[0]==0x04) d->reg[0x04]=tx[1];
+    return len;
+}
+
+static int _stts751_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    int i;
+    d->reg[0x01] = _busy(d) ? 0x80 : 0x00;     // Busy
+    for(i=0;i<len;i++) rx[i]=d->reg[d->ptr];
+    return 0;
+}
+
+/* AM2320 (25.0℃ 50.0%) */
+static uint16_t _crc16(const uint8_t *p, int len){
+    uint16_t crc=0xFFFF;
+    int i,j;
+    for(i=0;i<len;i++){
+        crc ^= p[i];
+        for(j=0;j<8;j++) crc = (crc&1) ? (uint16_t)((crc>>1)^0xA001) : (uint16_t)(crc>>1);
+    }
+    return crc;
+}
+
+static void _am2320_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    _put16(&d->reg[0x00],500);          // 湿度 x10
+    _put16(&d->reg[0x02],250);          // 温度 x10
+    d->awake=0;
+    d->cmd=0;
+}
+
+static void _am2320_done(sim_dev *d){
+    int n=d->buf[1];
+    memcpy(&d->buf[2],&d->reg[d->ptr],n);
+    _put16le(&d->buf[2+n],_crc16(d->buf,2+n));
+}
+
+static int _am2320_write(sim_dev *d, const uint8_t *tx, int len){
+    if(!d->awake){                      // 休止中はアドレスに NACK して起動する
+        d->awake=1;
+        return -1;
+    }
+    if(len>=3 && tx[0]==0x03 && tx[2]>=1 && tx[2]<=10){
+        d->cmd=0x03;
+        d->ptr=tx[1];
+        d->buf[0]=0x03;
+        d->buf[1]=tx[2];
+        _start(d,1500);
+    }
+    return len;
+}
+
+static int _am2320_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    int i;
+    if(!d->awake || d->cmd!=0x03 || _busy(d)) return -1;
+    for(i=0;i<len;i++) rx[i] = i<d->buf[1]+4 ? d->buf[i] : 0;
+    d->awake=0;                         // 応答後は休止
+    d->cmd=0;
+    return 0;
+}
+
+/* ADS1115 (AIN0～3 = 0.5, 1.0, 1.5, 2.0V) */
+static void _ads1115_reset(sim_dev *d){
+    memset(d->reg,0,sizeof(d->reg));
+    _put16(&d->reg[0x02],0x8583);       // Config (16ビットのレジスタ n は reg[n*2])
+    _put16(&d->reg[0x04],0x8000);       // Lo_thresh
+    _put16(&d->reg[0x06],0x7FFF);       // Hi_thresh
+    d->ptr=0;
+}
+
+static void _ads1115_done(sim_dev *d){
+    static const double fs[8]={6.144,4.096,2.048,1.024,0.512,0.256,0.256,0.256};
+    static const int8_t pos[8]={0,0,1,2,0,1,2,3}, neg[8]={1,3,3,3,-1,-1,-1,-1};
+    uint16_t cfg=(uint16_t)((d->reg[0x02]<<8)|d->reg[0x03]);
+    uint8_t mux=(cfg>>12)&7;
+    double v = 0.5*(pos[mux]+1) - (neg[mux]<0 ? 0. : 0.5*(neg[mux]+1));
+    double code = v/fs[(cfg>>9)&7]*32768.;
+    if(code>32767.) code=32767.;
+    if(code<-32768.) code=-32768.;
+    _put16(&d->reg[0x00],(uint16_t)(int16_t)code);
+    d->reg[0x02] |= 0x80;               // OS: 変換完了
+    if(!(cfg&0x0100)) _start(d,1000000u/(8u<<((cfg>>5)&7)));    // 連続変換
+}
+
+static int _ads1115_write(sim_dev *d, const uint8_t *tx, int len){
+    static const uint16_t sps[8]={8,16,32,64,128,250,475,860};
+    uint16_t v;
+    if(len==0) return 0;
+    d->ptr=tx[0]&0x03;
+    if(len<3 || d->ptr==0x00) return len;
+    v=(uint16_t)((tx[1]<<8)|tx[2]);
+    if(d->ptr!=0x01){
+        _put16(&d->reg[d->ptr*2],v);
+        return len;
+    }
+    _put16(&d->reg[0x02],v&0x7FFF);     // 変換中は OS=0
+    if(!(v&0x0100) || (v&0x8000)) _start(d,1000000u/sps[(v>>5)&7]);
+    else d->reg[0x02] |= 0x80;
+    return len;
+}
+
+static int _ads1115_read(sim_dev *d, uint8_t *rx, int len, uint32_t *stretch_us){
+    int i;
+    _busy(d);
+    for(i=0;i<len;i++) rx[i]=d->reg[d->ptr*2+(i&1)];
+    return 0;
+}
+
+/* ST7032 液晶 (DDRAM 0x00～0x27 が1行目、0x40～0x67 が2行目) */
+static void _lcd_reset(sim_dev *d){
+    memset(d->reg,' ',sizeof(d->reg));
+    d->ptr=0;
+}
+
+static void _lcd_exec(sim_dev *d, uint8_t rs, uint8_t v){
+    if(_busy(d)){                       // 実行中の書込みは無視される
+        d->fault++;
+        return;
+    }
+    if(rs){
+        d->reg[d->ptr]=v;
+        d->ptr=(uint8_t)((d->ptr+1)&0x7F);
+        _start(d,26);
+        return;
+    }
+    if(v==0x01){                        // Clear Display
+        memset(d->reg,' ',sizeof(d->reg));
+        d->ptr=0;
+        _start(d,1080);
+        return;
+    }
+    if((v&0xFE)==0x02) d->ptr=0;        // Return Home
+    if(v&0x80) d->ptr=v&0x7F;           // Set DDRAM Address
+    _start(d,(v&0xFE)==0x02 ? 1080 : 26);
+}
+
+static int _lcd_write(sim_dev *d, const uint8_t *tx, int len){
+// 制御バイト(Co, RS)とデータの組。Co=0 の後は全て同じ種類のデータ
+    int i=0;
+    uint8_t c;
+    while(i<len){
+        c=tx[i++];
+        if(!(c&0x80)){
+            while(i<len) _lcd_exec(d,c&0x40,tx[i++]);
+            break;
+        }
+        if(i<len) _lcd_exec(d,c&0x40,tx[i++]);
+    }
+    return len;
+}
+
+static const sim_model _models[]={
+    {"bme280", 0x76,0,_bme280_reset, _bme280_write, _bme280_read, _bme280_done},
+    {"adxl345",0x1D,0,_adxl345_reset,_adxl345_write,_adxl345_read,_adxl345_done},
+    {"ccs811", 0x5A,50,_ccs811_reset,_ccs811_write, _ccs811_read, _ccs811_done},
+    {"si7021", 0x40,0,_si7021_reset, _si7021_write, _si7021_read, NULL},
+    {"hdc1000",0x41,0,_hdc1000_reset,_hdc1000_write,_hdc1000_read,_hdc1000_done},
+    {"lps25h", 0x5D,0,_lps25h_reset, _lps25h_write, _lps25h_read, _lps25h_done},
+    {"stts751",0x39,0,_stts751_reset,_stts751_write,_stts751_read,_stts751_done},
+    {"am2320", 0x5C,0,_am2320_reset, _am2320_write, _am2320_read, _am2320_done},
+    {"ads1115",0x48,0,_ads1115_reset,_ads1115_write,_ads1115_read,_ads1115_done},
+    {"lcd",    0x3E,0,_lcd_reset,    _lcd_write,    NULL,         NULL},
+    {NULL,0,0,NULL,NULL,NULL,NULL}
+};
+
+static int _add(const char *s, int len){
+// デバイス名[@アドレス][/ストレッチ] 戻り値：０の時はエラー
+    const sim_model *m;
+    sim_dev *d;
+    char name[16];
+    const char *p;
+    int n;
+    for(n=0;n<len && n<15 && s[n]!='@' && s[n]!='/';n++) name[n]=s[n];
+    name[n]='\0';
+    for(m=_models;m->name && strcmp(m->name,name);m++);
+    if(!m->name || _devs>=SIM_DEVS){
+        fprintf(stderr,"i2c_sim: unknown device %.*s\n",len,s);
+        return 0;
+    }
+    d=&_dev[_devs++];
+    memset(d,0,sizeof(sim_dev));
+    d->m=m;
+    d->adr=m->adr;
+    d->stretch_us=m->stretch_us;
+    p=memchr(s,'@',len);
+    if(p) d->adr=(uint8_t)(strtol(p+1,NULL,16)&0x7F);
+    p=memchr(s,'/',len);
+    if(p) d->stretch_us=(uint32_t)strtoul(p+1,NULL,10);
+    m->reset(d);
+    return 1;
+}
+
+static int _parse(const char *s){
+// 戻り値：置いたデバイスの数(-1:エラー)
+    const char *e;
+    int len,n=0;
+    for(;*s;s=*e ? e+1 : e){
+        e=strchr(s,',');
+        if(!e) e=s+strlen(s);
+        len=(int)(e-s);
+        if(len==0) continue;
+        if(!strncmp(s,"latency=",8)) _latency=atof(s+8);
+        else if(!strncmp(s,"nack=",5)) _nack_p=atof(s+5);
+        else if(!strncmp(s,"flip=",5)) _flip_p=atof(s+5);
+        else if(!strncmp(s,"stuck=",6)) _stuck_p=atof(s+6);
+        else if(!strncmp(s,"seed=",5)) _rand_x=(uint32_t)strtoul(s+5,NULL,10);
+        else if(len==7 && !strncmp(s,"verbose",7)) _verbose=1;
+        else if(!_add(s,len)) return -1;
+        else n++;
+    }
+    return n;
+}
+
+int i2c_sim_open(void){
+// 環境変数 SOFT_I2C_SIM のデバイスを置く 戻り値：０の時はエラー
+    const char *env=getenv("SOFT_I2C_SIM");
+    int n;
+    if(_opened++) return 1;
+    _devs=0;
+    _latency=1.;
+    _nack_p=_flip_p=_stuck_p=0.;
+    _rand_x=1;
+    _stuck=0;
+    _verbose=0;
+    n=_parse(env ? env : "");
+    if(n==0) n=_parse(SIM_DEFAULT);
+    _rand_x*=2654435761u;               // 小さい seed でも初めから散らばるように
+    if(_rand_x==0) _rand_x=1;
+    if(n<0){
+        _opened=0;
+        return 0;
+    }
+    return 1;
+}
+
+void i2c_sim_close(void){
+    sim_dev *d;
+    int i;
+    if(_opened==0 || --_opened) return;
+    if(!_verbose) return;
+    for(i=0;i<_devs;i++){
+        d=&_dev[i];
+        fprintf(stderr,"i2c_sim: %02X %-8s xfer %u nack %u fault %u samples %u\n",
+            d->adr,d->m->name,d->xfer,d->nack,d->fault,d->samples);
+        if(d->m->reset==_lcd_reset){
+            fprintf(stderr,"i2c_sim: %02X [%.16s]\n",d->adr,(char *)&d->reg[0x00]);
+            fprintf(stderr,"i2c_sim: %02X [%.16s]\n",d->adr,(char *)&d->reg[0x40]);
+        }
+    }
+}
+
+int i2c_sim_xfer(uint8_t adr, const uint8_t *tx, int txlen, uint8_t *rx, int rxlen, uint32_t *stretch_us){
+/*
+adr に tx を送信し、rx が NULL でなければ Repeated START で rxlen バイトを受信する
+(txlen が0で rx があるときは受信のみ、どちらもないときはアドレスのみ)
+出力：uint32_t *stretch_us = デバイスが SCL を L に保持した時間[us]
+戻り値：I2C_SIM_*
+*/
+    sim_dev *d=NULL;
+    int i,r;
+    *stretch_us=0;
+    if(_stuck) return I2C_SIM_STUCK;
+    for(i=0;i<_devs;i++) if(_dev[i].adr==(adr&0x7F)) d=&_dev[i];
+    if(!d) return I2C_SIM_NACK_ADR;
+    d->xfer++;
+    if(_chance(_nack_p)){
+        d->nack++;
+        d->fault++;
+        return I2C_SIM_NACK_ADR;
+    }
+    if(txlen>0 || !rx){
+        r=d->m->write(d,tx,txlen);
+        if(r<0){
+            d->nack++;
+            return I2C_SIM_NACK_ADR;
+        }
+        if(r<txlen){
+            d->nack++;
+            return I2C_SIM_NACK_DATA;
+        }
+    }
+    if(rx){
+        if(!d->m->read || d->m->read(d,rx,rxlen,stretch_us)<0){
+            d->nack++;
+            return I2C_SIM_NACK_ADR;
+        }
+        *stretch_us += d->stretch_us;
+        for(i=0;i<rxlen;i++) if(_chance(_flip_p)){
+            rx[i] ^= (uint8_t)(1<<(_rand()%8));
+            d->fault++;
+        }
+    }
+    if(_chance(_stuck_p)){
+        _stuck=1;
+        d->fault++;
+    }
+    return I2C_SIM_OK;
+}
+
+int i2c_sim_recover(int *clocks){
+// SCL のクロックで固着した SDA を解放する 戻り値：０の時は復旧できなかった
+    *clocks = _stuck ? (int)(_rand()%9)+1 : 0;
+    _stuck=0;
+    return 1;
+}
@@ -0,0 +1,25 @@
+/*******************************************************************************
+Raspberry Pi用 ソフトウェアI2C soft_i2c の模擬バス i2c_sim
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+SOFT_I2C_BACKEND=sim のときに soft_i2c が通信を渡すデバイスモデルの集まり。
+1回の通信(送信と Repeated START 後の受信)を単位とし、プロセスに1つのバスを持つ。
+sim 方式のバスはすべて同じデバイスを共有し、1つのスレッドからのみ使用する。
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#include <stdint.h>
+
+#define I2C_SIM_OK          0                       // 成功
+#define I2C_SIM_NACK_ADR    1                       // アドレスに ACK なし
+#define I2C_SIM_NACK_DATA   2                       // 送信データに ACK なし
+#define I2C_SIM_STUCK       3                       // SDA が L に固着 (i2c_sim_recover で解放)
+
+int i2c_sim_open(void);
+void i2c_sim_close(void);
+int i2c_sim_xfer(uint8_t adr, const uint8_t *tx, int txlen, uint8_t *rx, int rxlen, uint32_t *stretch_us);
+int i2c_sim_recover(int *clocks);
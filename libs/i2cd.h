@@ -0,0 +1,26 @@
+/*******************************************************************************
+Raspberry Pi用 I2C バスデーモン i2cd の通信手順
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+UNIX ドメインソケット(SOCK_SEQPACKET)で1回の送信を1つの要求とする。
+
+要求  : [命令数 n] に続けて n 個の命令
+        命令 = [種類][アドレス][送信長][受信長] + 送信データ(送信長バイト)
+応答  : 命令ごとに [結果] + 受信データ(受信長バイト、エラー時は0で埋める)
+        結果は soft_i2c の各関数の戻り値(0:エラー、以降の命令は実行せず0)
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#define I2CD_SOCK       "/tmp/soft_i2c_i2cd.sock"   // 既定のソケット (環境変数 SOFT_I2C_I2CD で変更可)
+#define I2CD_FRAME      4096                        // 要求・応答の最大長
+#define I2CD_OP_HEAD    4                           // 命令の先頭部の長さ
+
+#define I2CD_CHECK      0                           // i2c_check(adr)
+#define I2CD_READ       1                           // i2c_read(adr,rx,受信長)
+#define I2CD_WRITE      2                           // i2c_write(adr,tx,送信長)
+#define I2CD_WRITE_READ 3                           // i2c_write_read(adr,tx,送信長,rx,受信長)
+#define I2CD_DELAY      4                           // delay(送信データ2バイト[ms] リトルエンディアン)
@@ -0,0 +1,220 @@
+/*******************************************************************************
+Raspberry Pi 実機なしで soft_i2c を動作させるための模擬デバイス mock_dev
+
+本ソースリストおよびソフトウェアは、ライセンスフリーです。(詳細は別記)
+利用、編集、再配布等が自由に行えますが、著作権表示の改変は禁止します。
+
+LD_PRELOAD で読み込み、open/ioctl/close を横取りして以下を模擬します。
+・/dev/gpiochipN   GPIO キャラクタデバイス(v2 uAPI)
+                   プルアップされたオープンドレインのバス(スレーブなし)として動作
+・/dev/i2c-N       i2c-dev (I2C_FUNCS, I2C_SLAVE, I2C_RDWR)
+                   MOCK_I2C_ADDR(16進数,カンマ区切り 既定 76)のアドレスに
+                   256バイトのレジスタを持つデバイスを置く(先頭の書込みバイトが
+                   レジスタ番号、以降は自動インクリメントで読み書き)
+
+コンパイル方法
+    gcc -Wall -O1 -shared -fPIC ../libs/mock_dev.c -o mock_dev.so -ldl
+
+使い方
+    LD_PRELOAD=./mock_dev.so SOFT_I2C_BACKEND=gpiochip ./raspi_i2cbench 200 gpiochip
+    LD_PRELOAD=./mock_dev.so SOFT_I2C_BACKEND=i2cdev MOCK_I2C_ADDR=3E,76 ./raspi_i2cdetect
+    MOCK_DEV_VERBOSE=1 を設定すると終了時に ioctl 回数を表示します
+
+                                        Copyright (c) 2014-2017 Wataru KUNINO
+                                        https://bokunimo.net/raspi/
+*******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define MOCK_FDS    1024                // 管理する fd の上限
+#define MOCK_NONE   0
+#define MOCK_CHIP   1                   // /dev/gpiochipN
+#define MOCK_LINE   2                   // line request
+#define MOCK_I2C    3                   // /dev/i2c-N
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_ioctl)(int, unsigned long, ...);
+static int (*real_close)(int);
+static char mock_type[MOCK_FDS];
+static uint64_t line_out=0;             // 出力設定中のライン(bit)
+static uint64_t line_val=0;             // 出力値
+static unsigned long n_ioctl=0;
+static uint8_t i2c_dev[128];            // 1:デバイスあり
+static uint8_t i2c_reg[128][256];       // 各デバイスのレジスタ
+static uint8_t i2c_ptr[128];            // レジスタ番号
+static int i2c_slave=-1;                // I2C_SLAVE で設定したアドレス
+
+static void mock_report(void){
+    if(getenv("MOCK_DEV_VERBOSE")) fprintf(stderr,"mock_dev: ioctl=%lu\n",n_ioctl);
+}
+
+static void mock_init(void){
+    if(real_open) return;
+    real_open=dlsym(RTLD_NEXT,"open");
+    real_ioctl=dlsym(RTLD_NEXT,"ioctl");
+    real_close=dlsym(RTLD_NEXT,"close");
+    atexit(mock_report);
+}
+
+static void mock_i2c_init(void){
+    const char *env=getenv("MOCK_I2C_ADDR");
+    char *p;
+    long adr;
+    if(env==NULL) env="76";
+    while(*env){
+        adr=strtol(env,&p,16);
+        if(p==env) break;
+        if(adr>=0 && adr<128) i2c_dev[adr]=1;
+        env = (*p==',') ? p+1 : p;
+    }
+}
+
+static int mock_fd(int type){
+    int fd=real_open("/dev/null",O_RDWR);
+    if(fd<0 || fd>=MOCK_FDS) return -1;
+    mock_type[fd]=type;
+    return fd;
+}
+
+static int mock_open(const char *path, int flags, va_list ap){
+    mode_t mode=0;
+    mock_init();
+    if(!strncmp(path,"/dev/gpiochip",13)) return mock_fd(MOCK_CHIP);
+    if(!strncmp(path,"/dev/i2c-",9)){
+        mock_i2c_init();
+        return mock_fd(MOCK_I2C);
+    }
+    if(flags & O_CREAT) mode=va_arg(ap,mode_t);
+    return real_open(path,flags,mode);
+}
+
+int open(const char *path, int flags, ...){
+    va_list ap;
+    int fd;
+    va_start(ap,flags);
+    fd=mock_open(path,flags,ap);
+    va_end(ap);
+    return fd;
+}
+
+int open64(const char *path, int flags, ...){
+    va_list ap;
+    int fd;
+    va_start(ap,flags);
+    fd=mock_open(path,flags,ap);
+    va_end(ap);
+    return fd;
+}
+
+int close(int fd){
+    mock_init();
+    if(fd>=0 && fd<MOCK_FDS) mock_type[fd]=MOCK_NONE;
+    return real_close(fd);
+}
+
+static int mock_gpio_ioctl(int fd, unsigned long req, void *arg){
+    struct gpio_v2_line_request *lr;
+    struct gpio_v2_line_config *cfg;
+    struct gpio_v2_line_values *val;
+    uint64_t out;
+    unsigned i;
+
+    n_ioctl++;
+    if(mock_type[fd]==MOCK_CHIP && req==GPIO_V2_GET_LINE_IOCTL){
+        lr=arg;
+        lr->fd=mock_fd(MOCK_LINE);
+        line_out=0;
+        line_val=0;
+        return lr->fd<0 ? -1 : 0;
+    }
+    if(mock_type[fd]!=MOCK_LINE) return -1;
+    switch(req){
+        case GPIO_V2_LINE_SET_CONFIG_IOCTL:
+            cfg=arg;
+            out = (cfg->flags & GPIO_V2_LINE_FLAG_OUTPUT) ? ~0ULL : 0;
+            for(i=0;i<cfg->num_attrs;i++){
+                if(cfg->attrs[i].attr.id==GPIO_V2_LINE_ATTR_ID_FLAGS){
+                    if(cfg->attrs[i].attr.flags & GPIO_V2_LINE_FLAG_OUTPUT)
+                        out |= cfg->attrs[i].mask;
+                    else out &= ~cfg->attrs[i].mask;
+                }
+                if(cfg->attrs[i].attr.id==GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES){
+                    line_val &= ~cfg->attrs[i].mask;
+                    line_val |= cfg->attrs[i].attr.values & cfg->attrs[i].mask;
+                }
+            }
+            line_out=out;
+            return 0;
+        case GPIO_V2_LINE_SET_VALUES_IOCTL:
+            val=arg;
+            line_val = (line_val & ~val->mask) | (val->bits & val->mask);
+            return 0;
+        case GPIO_V2_LINE_GET_VALUES_IOCTL:
+            val=arg;                    // 入力時はプルアップで H
+            val->bits = ((line_val & line_out) | ~line_out) & val->mask;
+            return 0;
+    }
+    return -1;
+}
+
+static int mock_i2c_msg(struct i2c_msg *msg){
+    int adr=msg->addr;
+    int i;
+    if(adr>=128 || !i2c_dev[adr]) return -1;        // NACK
+    if(msg->flags & I2C_M_RD){
+        for(i=0;i<msg->len;i++) msg->buf[i]=i2c_reg[adr][i2c_ptr[adr]++];
+        return 0;
+    }
+    for(i=0;i<msg->len;i++){
+        if(i==0) i2c_ptr[adr]=msg->buf[0];
+        else i2c_reg[adr][i2c_ptr[adr]++]=msg->buf[i];
+    }
+    return 0;
+}
+
+static int mock_i2c_ioctl(unsigned long req, void *arg){
+    struct i2c_rdwr_ioctl_data *rdwr;
+    unsigned i;
+    n_ioctl++;
+    switch(req){
+        case I2C_FUNCS:
+            *(unsigned long *)arg = I2C_FUNC_I2C;
+            return 0;
+        case I2C_SLAVE:
+        case I2C_SLAVE_FORCE:
+            i2c_slave=(int)(unsigned long)arg;
+            return 0;
+        case I2C_RDWR:
+            rdwr=arg;
+            for(i=0;i<rdwr->nmsgs;i++){
+                if(mock_i2c_msg(&rdwr->msgs[i])) return -1;
+            }
+            return (int)rdwr->nmsgs;
+    }
+    return -1;
+}
+
+int ioctl(int fd, unsigned long req, ...){
+    va_list ap;
+    void *arg;
+    mock_init();
+    va_start(ap,req);
+    arg=va_arg(ap,void *);
+    va_end(ap);
+    if(fd>=0 && fd<MOCK_FDS && mock_type[fd]==MOCK_I2C)
+        return mock_i2c_ioctl(req,arg);
+    if(fd>=0 && fd<MOCK_FDS && mock_type[fd]!=MOCK_NONE)
+        return mock_gpio_ioctl(fd,req,arg);
+    return real_ioctl(fd,req,arg);
+}
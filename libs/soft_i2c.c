@@ -18,57 +18,283 @@ Arduino標準ライブラリ「Wire」は使用していない(I2Cの手順の
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>						// uint32_t
+#include <stddef.h>						// offsetof用
 #include <unistd.h>         			// usleep用
 #include <ctype.h>						// isprint用
-#include <sys/time.h>					// gettimeofday用
+#include <time.h>						// clock_gettime, clock_nanosleep用
+#include <errno.h>						// EINTR用
 #include <string.h>						// strncpy用
+#include <fcntl.h>						// open用
+#include <sys/ioctl.h>					// ioctl用
+#include <sys/mman.h>					// mmap用
+#include <sys/stat.h>					// fstat用
+#include <sys/file.h>					// flock用
+#include <signal.h>						// kill用(ロック待ち行列のプロセス確認)
+#include <sys/socket.h>					// i2cd 用
+#include <sys/un.h>
+#include <linux/gpio.h>					// GPIO キャラクタデバイス(v2 uAPI)用
+#include <linux/i2c.h>					// i2c-dev 用
+#include <linux/i2c-dev.h>
+#include "i2cd.h"						// i2cd デーモンの通信手順
+#include "i2c_sim.h"					// 模擬バス
+#include "i2c_bench.h"					// --bench の集計
 
 #define I2C_lcd 0x3E							// LCD の I2C アドレス 
-#define PORT_SCL	"/sys/class/gpio/gpio3/value"		// I2C SCLポート
-#define PORT_SDA	"/sys/class/gpio/gpio2/value"		// I2C SDAポート
+#define GPIO_SYSFS	"/sys/class/gpio"					// GPIO sysfs (環境変数 SOFT_I2C_SYSFS で変更可)
 #define PORT_SDANUM	2									// I2C SDAポートの番号
 														// SCLはSDA+1(固定)
+#define GPIO_SYSFS_IO	0						// GPIO 方式:毎回 fopen/fclose する sysfs
+#define GPIO_FD_IO		1						// GPIO 方式:sysfs を開いたまま pread/pwrite
+#define GPIO_CHIP_IO	2						// GPIO 方式:/dev/gpiochipN の line request
+#define GPIO_CHIP	"/dev/gpiochip0"			// gpiochip (環境変数 SOFT_I2C_GPIOCHIP で変更可)
+#define GPIO_MMAP_IO	3						// GPIO 方式:/dev/gpiomem のレジスタを直接操作
+#define GPIO_MEM	"/dev/gpiomem"				// GPIO レジスタ (環境変数 SOFT_I2C_GPIOMEM で変更可)
+#define GPIO_MEM_SIM	"/tmp/soft_i2c_gpiomem"	// GPIO_MEM が無いときの模擬レジスタファイル
+#define GPIO_MEM_SIZE	4096
+#define GPFSEL0		0							// レジスタ位置(32bitワード単位)
+#define GPSET0		7
+#define GPCLR0		10
+#define GPLEV0		13
+#define I2C_DEV_IO	4							// ハードウェアI2C:/dev/i2c-N (ビットバングしない)
+#define I2C_DEV		"/dev/i2c-1"				// i2c-dev (環境変数 SOFT_I2C_DEV で変更可)
+#define I2CD_IO		5							// i2cd デーモン経由 (バスはデーモンが使用)
+#define I2C_SIM_IO	6							// 模擬バス:libs/i2c_sim.c のデバイスモデル (環境変数 SOFT_I2C_SIM)
+#define I2C_REPLAY_IO	7						// 記録の再生:SOFT_I2C_RECORD の記録の応答を返す (環境変数 SOFT_I2C_REPLAY)
+#ifndef SOFT_I2C_BACKEND
+#define SOFT_I2C_BACKEND	GPIO_FD_IO			// 既定の GPIO 方式 (環境変数 SOFT_I2C_BACKEND で変更可)
+#endif
+#define LINE_SDA	0						// _gpio_* の対象ライン番号
+#define LINE_SCL	1
 #define INPUT		"in"
 #define OUTPUT		"out"
 #define LOW			0
 #define HIGH		1
-#define	I2C_RAMDA	15					// I2C データシンボル長[us]
+#define	I2C_RAMDA	15					// I2C データシンボル長[us] (環境変数 SOFT_I2C_SPEED で変更可)
+#define SPIN_NS     50000       		// この時間[ns]未満の待ち時間はスピンで待つ(初期値)
+#define STRETCH_MS	50					// クロックストレッチを待つ上限[ms] (環境変数 SOFT_I2C_STRETCH で変更可 0:確認しない)
+#define RAMDA_MIN	250					// 自動調整するシンボル長の下限[ns]
+#define CAL_TRIAL	8					// 自動調整の各候補での試行回数
+#define TIMING_DIR	"/tmp"				// アドレス別シンボル長の保存先 (環境変数 SOFT_I2C_TIMING でファイル指定可)
+#define INVENTORY_DIR	"/tmp"			// アドレス検索結果の保存先 (環境変数 SOFT_I2C_INVENTORY でファイル指定可)
+#define STATS_DIR	"/dev/shm"			// 通信の統計の共有メモリ (環境変数 SOFT_I2C_STATS で有効化)
+#define STATS_BUCKETS	152				// 応答時間のヒストグラムの区間数 (1us～2s、2倍ごとに8分割)
+#define STATS_MAGIC	"SI2CST1"			// 統計ファイルの識別子(配置を変えたら更新)
+#define TRACE_DIR	"/tmp"				// 波形(VCD)の保存先 (環境変数 SOFT_I2C_TRACE で有効化)
+#define TRACE_EVENTS	65536			// 波形のリングバッファの記録数(超えると古い記録から上書き)
+#define RECORD_DIR	"/tmp"				// 通信の記録の保存先 (環境変数 SOFT_I2C_RECORD で有効化)
+#define RECORD_MAGIC	"SI2CRC1"		// 記録ファイルの識別子(形式を変えたら更新)
+#define LOCK_DIR	"/tmp"				// バスのロックファイルの保存先 (環境変数 SOFT_I2C_LOCK でファイル指定可)
+#define LOCK_MS		5000				// バスのロックを待つ上限[ms] (環境変数 SOFT_I2C_LOCK_MS で変更可 0:ロックしない)
+#define LOCK_QUEUE	64					// ロック待ち行列の最大数
 #define GPIO_RETRY  50      			// GPIO 切換え時のリトライ回数
+#define I2C_LANES	8					// SCL を共有して同時に通信する SDA の最大数(GPIO_MMAP_IO のみ)
 #define S_NUM       16       			// 文字列の最大長
+#define S_PATH      128      			// GPIO パスの最大長
 //	#define DEBUG               		// デバッグモード
 
 typedef unsigned char byte; 
-FILE *fgpio;
-char buf[S_NUM];
-struct timeval micros_time;				//time_t micros_time;
-int micros_prev,micros_sec;
-int ERROR_CHECK=1;								// 1:ACKを確認／0:ACKを無視する
-static byte _lcd_size_x=8;
-static byte _lcd_size_y=2;
+#include "soft_i2c.h"							// i2c_batch 用
+int ERROR_CHECK=1;								// 1:ACKを確認／0:ACKを無視する (既定のバス)
+
+typedef struct i2c_bus i2c_bus;
+struct i2c_bus {							// バスごとの状態 (i2c_*_ex の第1引数)
+	int sda, scl;							// SDA と SCL の GPIO 番号
+	int lanes;								// SDA の数 (2以上は i2c_write_read_lanes 用)
+	int lane_sda[I2C_LANES];				// 各レーンの SDA の GPIO 番号 ([0]は sda と同じ)
+	int error_check;						// 1:ACKを確認／0:ACKを無視する
+	int backend;							// 使用中の GPIO 方式(または I2C_DEV_IO)
+	char port_sda[S_PATH];					// I2C SDAポート (sysfs の value)
+	char port_scl[S_PATH];					// I2C SCLポート
+	char name[S_NUM];						// バスの識別名
+	int fd_val[2];							// GPIO_FD_IO 用 value   [0]:SDA [1]:SCL
+	int fd_dir[2];							// GPIO_FD_IO 用 direction
+	int chip_fd;							// GPIO_CHIP_IO 用 line request の fd
+	byte chip_out;							// GPIO_CHIP_IO 出力(L)設定中のライン bit0:SDA bit1:SCL
+	volatile uint32_t *map;					// GPIO_MMAP_IO 用 レジスタ
+	byte map_sim;							// 1:通常ファイルを模擬レジスタとして使用中
+	int dev_fd;								// I2C_DEV_IO 用 /dev/i2c-N の fd
+	int i2cd_fd;							// I2CD_IO 用 デーモンへのソケット
+	signed char line_dir[2];				// 設定済みの方向 -1:不明 0:入力(H Imp) 1:出力(L) [0]:SDA [1]:SCL
+	byte line_low[2];						// 1:出力値Lを設定済み(以降は方向の切り換えのみ)
+	uint32_t io_n;							// 実行した GPIO 操作(方向・出力値の設定)の回数
+	uint32_t io_skip;						// 状態が同じため省略した GPIO 操作の回数
+	byte mux_adr;							// 選択中の TCA9548A のアドレス (0:選択なし)
+	byte mux_ch;							// 選択中のチャネル
+	uint32_t mux_sel;						// TCA9548A の選択の書込み回数
+	uint32_t mux_skip;						// 選択中と同じため省略した回数
+	struct stats_shm *stats;				// 通信の統計 (NULL:記録しない)
+	int stats_depth;						// 統計を記録中の関数の入れ子の深さ
+	byte stats_adr;							// 記録中の通信先アドレス (0:通信外)
+	byte nack;								// 記録中の通信の NACK (STATS_NACK_*)
+	uint64_t stats_t0;						// 記録中の通信の開始時刻[ns]
+	struct trace_buf *trace;				// 波形の記録 (NULL:記録しない)
+	uint64_t stretch_ns;					// 記録中の通信のクロックストレッチ[ns] (--bench)
+	struct rec_out *rec;					// 通信の記録 (NULL:記録しない)
+	struct rec_in *replay;					// 再生する記録 (I2C_REPLAY_IO)
+	uint32_t ramda;							// データシンボル長[ns] (通信中のアドレス用)
+	uint32_t ramda_def;						// 既定のデータシンボル長[ns]
+	uint32_t ramda_adr[128];				// アドレス別のデータシンボル長[ns] (0:既定値)
+	uint64_t deadline;						// 次のバス操作の予定時刻[ns] (CLOCK_MONOTONIC)
+	uint32_t stretch_ms;					// クロックストレッチを待つ上限[ms]
+	int reset_port;							// バス復旧用のリセット GPIO (環境変数 SOFT_I2C_RESET)
+	uint32_t recover_n;						// バス復旧の回数
+	uint32_t recover_fail;					// 復旧できなかった回数
+	uint64_t recover_sum, recover_max;		// 復旧に要した時間の合計と最大[ns]
+	byte quiet;								// 1:エラー表示を抑制(自動調整中など)
+	uint64_t scl_prev;						// SCL 立上りの前回時刻[ns]
+	uint32_t scl_n;							// SCL 周期の測定回数
+	uint64_t scl_sum;						// SCL 周期の合計[ns]
+	uint32_t scl_min, scl_max;				// SCL 周期の最小と最大[ns]
+	byte lcd_x, lcd_y;						// 液晶の桁数と行数
+	int lock_fd;							// バスのロックファイル (-1:ロックしていない)
+	uint32_t lock_n;						// ロックの取得回数
+	uint32_t lock_timeout;					// ロック待ちのタイムアウト回数
+	uint64_t lock_sum, lock_max;			// ロック待ち時間の合計と最大[ns]
+};
+
+static i2c_bus _bus0;						// 既定のバス (従来の i2c_* 関数で使用)
+static uint32_t _spin_ns=SPIN_NS;			// スピン待ちに切り換える閾値[ns] (プロセス共通)
+static uint64_t _micros_base=0;				// ログ時刻の基準[ns] (各 i2c_init で更新、表示のみに使用)
+static volatile int _fsel_lock=0;			// GPFSEL の読み書き(全バス共通のレジスタ)の排他
+
+/* バスのタイミング
+	CLOCK_MONOTONIC の絶対時刻で待つ。短い待ち(_spin_ns 未満)は
+	clock_nanosleep の寝過ごしを避けるためスピンで待つ。
+	バス操作の待ちは前回の予定時刻からの間隔とし、GPIO 操作の時間を
+	シンボル長に含める(遅れたときは現在時刻から数え直す)。
+*/
+static uint64_t _now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
 
 int _micros(){
-	int micros;
-	gettimeofday(&micros_time, NULL);    // time(&micros_time);
-	micros = micros_time.tv_usec;
-	if(micros_prev > micros ) micros_sec++;
-	micros_prev = micros;
-	micros += micros_sec * 1000000;
-	return micros;
+	return (int)((_now_ns()-__sync_fetch_and_add(&_micros_base,0))/1000);
 }
 
 void _micros_0(){
-	micros_sec=0;
+	__sync_lock_test_and_set(&_micros_base,_now_ns());	// 別スレッドの i2c_init_ex と重なってもよい
+}
+
+static void _sleep_until(uint64_t t){
+	struct timespec ts;
+	uint64_t now=_now_ns();
+	if(t > now + _spin_ns){
+		ts.tv_sec  = (t - _spin_ns) / 1000000000ull;
+		ts.tv_nsec = (t - _spin_ns) % 1000000000ull;
+		while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL)==EINTR) ;
+	}
+	while(_now_ns() < t) ;
+}
+
+/* プロセスで1回だけの初期化 (別スレッドの i2c_init_ex から同時に呼ばれてもよい)
+	if(_once_begin(&st)){ 初期化; _once_end(&st); } の形で使う。
+	最初のスレッドが初期化する間、他のスレッドは完了を待つ。
+*/
+static byte _once_begin(volatile int *st){
+// 戻り値：1 の時は呼出し元が初期化して _once_end を呼ぶ
+	if(__sync_bool_compare_and_swap(st,0,1)) return 1;	// 0:未実行 1:実行中 2:完了
+	while(__sync_fetch_and_add(st,0)!=2) ;
+	return 0;
+}
+
+static void _once_end(volatile int *st){
+	__sync_bool_compare_and_swap(st,1,2);	// 初期化の結果を完了より先に見せる(全バリア)
+}
+
+static void _spin_calibrate(void){
+// clock_nanosleep の寝過ごし時間を測定してスピン待ちの閾値にする
+	static volatile int st=0;
+	struct timespec ts;
+	uint64_t t,over,max=0;
+	int i;
+	if(!_once_begin(&st)) return;
+	for(i=0;i<5;i++){
+		t=_now_ns()+20000;
+		ts.tv_sec  = t / 1000000000ull;
+		ts.tv_nsec = t % 1000000000ull;
+		clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL);
+		over=_now_ns()-t;
+		if(over>max) max=over;
+	}
+	max += max/2;
+	if(max<10000) max=10000;
+	if(max>200000) max=200000;
+	_spin_ns=(uint32_t)max;
+	_once_end(&st);
+}
+
+static void _delayNanoseconds(i2c_bus *b, uint32_t ns){
+	uint64_t now=_now_ns();
+	b->deadline += ns;
+	if(b->deadline < now) b->deadline = now + ns;
+	_sleep_until(b->deadline);
+}
+
+
+/* 測定の繰返しと所要時間の内訳 (--bench N、集計は i2c_bench.c)
+	--bench の集計中は、成功した通信を bus、delay() を sleep、失敗した通信
+	(変換中の NACK)とクロックストレッチを wait に数える。
+*/
+static void _bench_sleep(uint64_t t, int kind){
+// t まで待ち、待った時間を内訳 kind に数える
+	uint64_t t0;
+	if(!i2c_bench_active()){
+		_sleep_until(t);
+		return;
+	}
+	t0=_now_ns();
+	_sleep_until(t);
+	i2c_bench_add(kind,_now_ns()-t0);
 }
 
-void _delayMicroseconds(int i){
-	usleep(i);
+static void _bench_xfer(i2c_bus *b, byte ret, uint64_t t){
+// 通信の所要時間 t[ns] を内訳に数える(失敗は変換中の NACK とみなす)
+	uint64_t st = b->stretch_ns<t ? b->stretch_ns : t;
+	i2c_bench_add(ret ? I2C_BENCH_BUS : I2C_BENCH_WAIT,t-st);
+	i2c_bench_add(I2C_BENCH_WAIT,st);
 }
 
 void delay(int i){
-	while(i){
-		_delayMicroseconds(1000);
-		i--;
+	if(i>0) _bench_sleep(_now_ns() + (uint64_t)i*1000000ull,I2C_BENCH_SLEEP);
+}
+
+void i2c_set_speed_ex(i2c_bus *b, uint32_t hz){
+// ビット当たり SDA 設定・SCL H・SCL L の3シンボルとしてシンボル長を設定する
+	if(hz==0) b->ramda_def=I2C_RAMDA*1000;
+	else b->ramda_def=1000000000ul/(hz*3);
+	b->ramda=b->ramda_def;
+	b->scl_n=0;
+	b->scl_sum=0;
+}
+
+static void _speed_env(i2c_bus *b){
+	const char *env=getenv("SOFT_I2C_SPEED");		// standard, fast, または周波数[Hz]
+	if(env==NULL || env[0]=='\0') return;
+	if(!strcmp(env,"standard")) i2c_set_speed_ex(b,100000);
+	else if(!strcmp(env,"fast")) i2c_set_speed_ex(b,400000);
+	else i2c_set_speed_ex(b,(uint32_t)atol(env));
+}
+
+static void _scl_edge(i2c_bus *b){
+// SCL 立上りの間隔を記録する(1ms以上の間隔はトランザクション間として除外)
+	uint64_t now=_now_ns();
+	uint64_t t=now-b->scl_prev;
+	if(b->scl_prev && t<1000000){
+		if(b->scl_n==0 || t<b->scl_min) b->scl_min=(uint32_t)t;
+		if(b->scl_n==0 || t>b->scl_max) b->scl_max=(uint32_t)t;
+		b->scl_sum += t;
+		b->scl_n++;
 	}
+	b->scl_prev=now;
+}
+
+uint32_t i2c_scl_stats_ex(i2c_bus *b, double *hz, double *jitter_ns){
+// 実測した SCL 周波数[Hz]と周期のジッタ(最大-最小)[ns] 戻り値：測定した周期数
+	if(hz) *hz = b->scl_n ? 1e9*b->scl_n/(double)b->scl_sum : 0.;
+	if(jitter_ns) *jitter_ns = b->scl_n ? (double)(b->scl_max-b->scl_min) : 0.;
+	return b->scl_n;
 }
 
 void i2c_debug(const char *s,byte priority){
@@ -85,12 +311,528 @@ void i2c_log(const char *s){
 	i2c_debug(s,1);
 }
 
+static void _bus_error(i2c_bus *b, const char *s){
+	if(!b->quiet) i2c_error(s);
+}
+
+/* 波形の記録 (VCD)
+	環境変数 SOFT_I2C_TRACE (1 または既定のバスのファイル名)で有効になり、
+	SDA, SCL の変化(方向の設定後の時刻と GPIO 操作の所要時間)、読み取った値、
+	通信(i2c_check/read/write/write_read)の開始と結果をリングバッファに記録する。
+	i2c_close で Value Change Dump として /tmp/soft_i2c_<バス名>.vcd に書き出し、
+	GTKWave で表示できる。io は GPIO 操作(システムコール)の実行中に1になるので、
+	シンボル長のうち GPIO 操作に要した時間と待ち時間の内訳が分かる。
+	無効時の処理は b->trace の確認のみ。
+*/
+#define TRACE_SDA		0					// 出力した SDA (H Imp=1)  TRACE_SDA+LINE_SCL は SCL
+#define TRACE_SCL		1
+#define TRACE_SDA_IN	2					// 読み取った SDA          TRACE_SDA_IN+LINE_SCL は SCL
+#define TRACE_SCL_IN	3
+#define TRACE_LANES		4					// 出力した全レーンの SDA (val:レーンのビット)
+#define TRACE_LANES_IN	5					// 読み取った全レーンの SDA
+#define TRACE_BEGIN		6					// 通信の開始 (val:アドレス 0:一括実行)
+#define TRACE_END		7					// 通信の終了 (val:0 成功、STATS_NACK_*、3 その他のエラー)
+typedef struct {
+	uint64_t t;								// 記録の開始からの時刻[ns]
+	uint32_t dt;							// GPIO 操作の所要時間[ns] (0:操作なし)
+	byte kind;								// TRACE_*
+	byte val;
+} trace_ev;
+struct trace_buf {
+	uint64_t t0;							// 記録の開始時刻[ns]
+	uint32_t n;								// 記録した数(TRACE_EVENTS を超えると上書き)
+	char path[S_PATH];						// 保存先 (空:既定)
+	trace_ev ev[TRACE_EVENTS];
+};
+
+static void _trace_open(i2c_bus *b){
+	const char *env=getenv("SOFT_I2C_TRACE");
+	if(!env || !env[0] || !strcmp(env,"0") || b->trace) return;
+	b->trace=(struct trace_buf *)malloc(sizeof(struct trace_buf));
+	if(!b->trace){
+		_bus_error(b,"i2c_trace / malloc Error");
+		return;
+	}
+	b->trace->n=0;
+	b->trace->path[0]='\0';
+	if(b==&_bus0 && env[0]=='/') snprintf(b->trace->path,S_PATH,"%s",env);
+	b->trace->t0=_now_ns();
+}
+
+static void _trace_add(i2c_bus *b, byte kind, byte val, uint64_t t_io){
+// t_io:GPIO 操作の開始時刻[ns] (0:操作なし)
+	trace_ev *e=&b->trace->ev[b->trace->n++ % TRACE_EVENTS];
+	uint64_t t=_now_ns();
+	e->t=t-b->trace->t0;
+	e->dt= t_io ? (uint32_t)(t-t_io) : 0;
+	e->kind=kind;
+	e->val=val;
+}
+
+static void _trace_bits(FILE *fp, byte val, int width, char id){
+	int i;
+	if(width==1){
+		fprintf(fp,"%d%c\n",val&1,id);
+		return;
+	}
+	fputc('b',fp);
+	for(i=width-1;i>=0;i--) fputc('0'+((val>>i)&1),fp);
+	fprintf(fp," %c\n",id);
+}
+
+static void _trace_time(FILE *fp, uint64_t t, uint64_t *last){
+	if(t<=*last) return;					// 同じ時刻(戻る時刻)は直前の時刻にまとめる
+	fprintf(fp,"#%llu\n",(unsigned long long)t);
+	*last=t;
+}
+
+static void _trace_save(i2c_bus *b){
+// 記録を VCD ファイルに書き出して記録を終える
+	static const char *end[4]={"ok","nack_a","nack_d","error"};
+	struct trace_buf *tr=b->trace;
+	char path[S_PATH];
+	trace_ev *e;
+	uint32_t i,first;
+	uint64_t last=0;
+	byte sda=0xFF, sda_in=0xFF, adr=0;
+	int w = b->lanes>1 ? b->lanes : 1;
+	time_t tm=time(NULL);
+	FILE *fp;
+	if(!tr) return;
+	b->trace=NULL;
+	if(tr->path[0]) snprintf(path,S_PATH,"%s",tr->path);
+	else snprintf(path,S_PATH,"%s/soft_i2c_%s.vcd",TRACE_DIR,i2c_bus_name_ex(b));
+	fp=fopen(path,"w");
+	if(!fp){
+		_bus_error(b,"i2c_trace / VCD write Error");
+		free(tr);
+		return;
+	}
+	first = tr->n>TRACE_EVENTS ? tr->n-TRACE_EVENTS : 0;
+	fprintf(fp,"$date %s$end\n",ctime(&tm));
+	fprintf(fp,"$version soft_i2c $end\n");
+	fprintf(fp,"$comment bus %s (%s) symbol %u ns, events %u (lost %u) $end\n",
+		i2c_bus_name_ex(b),i2c_backend_name_ex(b),b->ramda_def,tr->n-first,first);
+	fprintf(fp,"$timescale 1ns $end\n$scope module %s $end\n",i2c_bus_name_ex(b));
+	fprintf(fp,"$var wire 1 ! scl $end\n$var wire %d \" sda $end\n",w);
+	fprintf(fp,"$var wire 1 # scl_in $end\n$var wire %d $ sda_in $end\n",w);
+	fprintf(fp,"$var wire 1 %% io $end\n$var wire 7 & adr $end\n$var string 1 ' xfer $end\n");
+	fprintf(fp,"$upscope $end\n$enddefinitions $end\n");
+	fprintf(fp,"#0\n$dumpvars\nx!\n%s\"\nx#\n%s$\n0%%\nbzzzzzzz &\nsidle '\n$end\n",
+		w>1 ? "bx " : "x",w>1 ? "bx " : "x");
+	for(i=first;i<tr->n;i++){
+		e=&tr->ev[i % TRACE_EVENTS];
+		if(e->dt){							// GPIO 操作の開始
+			_trace_time(fp,e->t-e->dt,&last);
+			fprintf(fp,"1%%\n");
+		}
+		_trace_time(fp,e->t,&last);
+		switch(e->kind){
+			case TRACE_SDA:		sda=(byte)((sda&~1)|(e->val&1));	// レーン0
+								_trace_bits(fp,sda,w,'"'); break;
+			case TRACE_LANES:	sda=e->val; _trace_bits(fp,sda,w,'"'); break;
+			case TRACE_SCL:		_trace_bits(fp,e->val,1,'!'); break;
+			case TRACE_SDA_IN:	sda_in=(byte)((sda_in&~1)|(e->val&1));
+								_trace_bits(fp,sda_in,w,'$'); break;
+			case TRACE_LANES_IN: sda_in=e->val; _trace_bits(fp,sda_in,w,'$'); break;
+			case TRACE_SCL_IN:	_trace_bits(fp,e->val,1,'#'); break;
+			case TRACE_BEGIN:
+				adr=e->val;
+				_trace_bits(fp,adr,7,'&');
+				if(adr) fprintf(fp,"s%02X '\n",adr);
+				else fprintf(fp,"sbatch '\n");
+				break;
+			case TRACE_END:
+				fprintf(fp,"bzzzzzzz &\ns%02X:%s '\n",adr,end[e->val&3]);
+				break;
+		}
+		if(e->dt) fprintf(fp,"0%%\n");
+	}
+	fclose(fp);
+	free(tr);
+}
+
+/* 通信の統計
+	アドレスごとに通信回数、転送バイト数、NACK(アドレス／データ)、i2c_start 時の
+	バスのロック、バス復旧、応答時間のヒストグラムを記録する。
+	記録先は /dev/shm/soft_i2c_<バス名>.stats を mmap した共有メモリで、同じバスを
+	使う全プロセス(raspi_i2cd を含む)が加算する。i2cd 方式のクライアントは
+	待ち時間を含む応答時間を soft_i2c_i2cd.stats に記録する。
+	環境変数 SOFT_I2C_STATS (1 または既定のバスのファイル名)か、各 raspi_* の
+	--stats (i2c_stats_opt)で有効になる。ファイルを削除すると0から数え直す。
+*/
+#define STATS_NACK_ADR	1
+#define STATS_NACK_DATA	2
+typedef struct {
+	uint32_t xfer;							// 通信回数
+	uint32_t bytes;							// 転送バイト数(成功した通信の送信と受信)
+	uint32_t nack_adr, nack_data;			// アドレス／データの NACK
+	uint32_t error;							// その他のエラー(i2c-dev, i2cd)
+	uint32_t start_lock;					// i2c_start 時に SDA, SCL が H でなかった回数
+	uint32_t recover;						// バス復旧の回数
+	uint32_t reserved;
+	uint64_t lat_sum, lat_max;				// 応答時間の合計と最大[ns]
+	uint32_t hist[STATS_BUCKETS];			// 応答時間[us]のヒストグラム
+} stats_adr;
+struct stats_shm {
+	char magic[8];
+	int64_t since;							// 記録の開始時刻 (time)
+	stats_adr adr[128];
+};
+static volatile int _stats_on=-1;			// 1:記録する 0:しない -1:環境変数を未確認 (プロセス共通)
+static byte _stats_dump=0;					// 1:i2c_close で表示 (--stats)
+
+static int _stats_index(uint64_t us){
+// 応答時間[us]のヒストグラムの区間 (8未満は1us刻み、以降は2倍ごとに8分割)
+	int msb;
+	if(us<8) return (int)us;
+	if(us>=(1ull<<21)) us=(1ull<<21)-1;
+	msb=63-__builtin_clzll(us);
+	return (msb-2)*8 + (int)((us>>(msb-3))&7);
+}
+
+static uint64_t _stats_value(int i){
+// 区間の上限[us]
+	if(i<8) return (uint64_t)i;
+	return ((uint64_t)(9+i%8)<<(i/8-1))-1;
+}
+
+static void _stats_open(i2c_bus *b){
+	const char *env=getenv("SOFT_I2C_STATS");
+	char path[S_PATH];
+	void *map;
+	int fd;
+	if(_stats_on<0) __sync_bool_compare_and_swap(&_stats_on,-1,env && env[0] && strcmp(env,"0"));
+	if(!_stats_on || b->stats) return;
+	if(b==&_bus0 && env && env[0]=='/') snprintf(path,S_PATH,"%s",env);
+	else snprintf(path,S_PATH,"%s/soft_i2c_%s.stats",STATS_DIR,
+		b->backend==I2CD_IO ? "i2cd" : b->backend==I2C_REPLAY_IO ? "replay" : i2c_bus_name_ex(b));
+	fd=open(path,O_RDWR|O_CREAT|O_CLOEXEC,0666);
+	if(fd<0){
+		_bus_error(b,"i2c_stats / open Error");
+		return;
+	}
+	flock(fd,LOCK_EX);						// 初期化が他のプロセスと重ならないように
+	if(ftruncate(fd,sizeof(struct stats_shm))<0 ||
+		(map=mmap(NULL,sizeof(struct stats_shm),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0))==MAP_FAILED){
+		_bus_error(b,"i2c_stats / mmap Error");
+		close(fd);
+		return;
+	}
+	b->stats=(struct stats_shm *)map;
+	if(memcmp(b->stats->magic,STATS_MAGIC,8)){	// 新規または配置の異なるファイル
+		memset(b->stats,0,sizeof(struct stats_shm));
+		memcpy(b->stats->magic,STATS_MAGIC,8);
+		b->stats->since=(int64_t)time(NULL);
+	}
+	close(fd);								// flock も解除される
+}
+
+static void _stats_close(i2c_bus *b){
+	if(b->stats) munmap(b->stats,sizeof(struct stats_shm));
+	b->stats=NULL;
+	b->stats_depth=0;
+}
+
+static void _stats_add(i2c_bus *b, size_t field){
+// 記録中のアドレスのカウンタ(stats_adr 内の位置)に1を加える
+	if(b->stats) __sync_fetch_and_add((uint32_t *)((char *)&b->stats->adr[b->stats_adr]+field),1);
+}
+
+static void _stats_begin(i2c_bus *b, byte adr){
+	if((!b->stats && !b->trace && !b->rec && !i2c_bench_active()) || b->stats_depth++) return;	// 入れ子の呼出しは外側で記録
+	b->stats_adr=adr&0x7F;
+	b->nack=0;
+	b->stretch_ns=0;
+	if(b->trace) _trace_add(b,TRACE_BEGIN,b->stats_adr,0);
+	b->stats_t0=_now_ns();
+}
+
+static void _stats_record(i2c_bus *b, byte adr, byte ok, uint32_t bytes, uint64_t t){
+	stats_adr *a=&b->stats->adr[adr&0x7F];
+	uint64_t max;
+	__sync_fetch_and_add(&a->xfer,1);
+	if(ok) __sync_fetch_and_add(&a->bytes,bytes);
+	else if(b->nack==STATS_NACK_DATA) __sync_fetch_and_add(&a->nack_data,1);
+	else if(b->nack==STATS_NACK_ADR || b->backend<I2C_DEV_IO) __sync_fetch_and_add(&a->nack_adr,1);
+	else __sync_fetch_and_add(&a->error,1);
+	__sync_fetch_and_add(&a->lat_sum,t);
+	__sync_fetch_and_add(&a->hist[_stats_index(t/1000)],1);
+	while( t>(max=a->lat_max) && !__sync_bool_compare_and_swap(&a->lat_max,max,t) ) ;
+}
+
+static byte _stats_end(i2c_bus *b, byte ret, uint32_t bytes){
+// 戻り値：ret (呼出し元の戻り値をそのまま返す)
+	if((!b->stats && !b->trace && !b->rec && !i2c_bench_active()) || --b->stats_depth) return ret;
+	if(i2c_bench_active()) _bench_xfer(b,ret,_now_ns()-b->stats_t0);
+	if(b->trace) _trace_add(b,TRACE_END,ret ? 0 : (b->nack ? b->nack : 3),0);
+	if(b->stats) _stats_record(b,b->stats_adr,ret!=0,bytes,_now_ns()-b->stats_t0);
+	b->stats_adr=0;
+	return ret;
+}
+
+void i2c_stats_opt(int *argc, char **argv){
+// 引数から --stats を取り除き、統計の記録と i2c_close での表示を有効にする
+	int i,j;
+	for(i=1,j=1;i<*argc;i++){
+		if(!strcmp(argv[i],"--stats")){
+			_stats_on=1;
+			_stats_dump=1;
+		}else argv[j++]=argv[i];
+	}
+	argv[j]=NULL;
+	*argc=j;
+}
+
+void i2c_stats_print_ex(i2c_bus *b){
+// 共有メモリの統計を標準エラー出力に表示する
+	stats_adr *a;
+	uint32_t sum,n,p[3];
+	const uint32_t q[3]={50,90,99};
+	int i,j,k;
+	char t[32];
+	time_t since;
+	if(!b->stats){
+		fprintf(stderr,"i2c_stats: not recorded (SOFT_I2C_STATS or --stats)\n");
+		return;
+	}
+	since=(time_t)b->stats->since;
+	strftime(t,sizeof(t),"%Y/%m/%d %H:%M:%S",localtime(&since));
+	fprintf(stderr,"i2c_stats: bus %s since %s\n",
+		b->backend==I2CD_IO ? "i2cd" : b->backend==I2C_REPLAY_IO ? "replay" : i2c_bus_name_ex(b),t);
+	fprintf(stderr,"adr   xfer    bytes nack_a nack_d  error  lock  recov   avg_us   p50   p90   p99   max_us\n");
+	for(i=0;i<128;i++){
+		a=&b->stats->adr[i];
+		if(!a->xfer && !a->start_lock && !a->recover) continue;
+		for(n=0,j=0;j<STATS_BUCKETS;j++) n+=a->hist[j];
+		for(k=0;k<3;k++){					// パーセンタイル(区間の上限値)
+			p[k]=0;
+			for(sum=0,j=0;j<STATS_BUCKETS && n;j++){
+				sum+=a->hist[j];
+				if((uint64_t)sum*100 >= (uint64_t)n*q[k]){
+					p[k]=(uint32_t)_stats_value(j);
+					if(p[k]>a->lat_max/1000) p[k]=(uint32_t)(a->lat_max/1000);	// 最大値を超えない
+					break;
+				}
+			}
+		}
+		if(i) snprintf(t,sizeof(t),"%02X",i);
+		else snprintf(t,sizeof(t),"--");	// 通信外(i2c_init 時の復旧など)
+		fprintf(stderr,"%s  %6u %8u %6u %6u %6u %5u %6u %8.1f %5u %5u %5u %8.1f\n",
+			t,a->xfer,a->bytes,a->nack_adr,a->nack_data,a->error,a->start_lock,a->recover,
+			a->xfer ? a->lat_sum/1000./a->xfer : 0.,p[0],p[1],p[2],a->lat_max/1000.);
+	}
+}
+
+/* 通信の記録と再生
+	環境変数 SOFT_I2C_RECORD (1 または既定のバスのファイル名)で、i2c_check/read/write/
+	write_read の呼出しごとに命令、アドレス、送信データ、結果、受信データ、開始時刻と
+	所要時間を /tmp/soft_i2c_<バス名>.rec に書き出す(入れ子の呼出しは外側のみ)。
+	SOFT_I2C_BACKEND=replay は記録ファイル(SOFT_I2C_REPLAY、既定は同じ SDA の記録)を
+	読み込み、命令、アドレス、送信データが一致する次の記録の結果と受信データを返す。
+	バス名は記録時の名前になり、速度表や各 raspi_* のキャッシュも記録時と同じものを
+	使う(統計のみ soft_i2c_replay.stats に分ける)。
+	最後まで一致しないときは先頭から探すので、1回分の記録で繰り返しの測定も再生できる。
+	バスの待ち時間なしで返し、SOFT_I2C_REPLAY_TIME=1 の時は記録時の所要時間を待つ。
+
+	ファイル形式 (数値はリトルエンディアン)
+		RECORD_MAGIC (8バイト)、バス名 (S_NUM バイト) に続けて記録を並べる
+		記録 = [命令 I2CD_*][アドレス][結果][NACK][送信長][受信長]
+		       [開始時刻[us] 4バイト][所要時間[us] 4バイト] + 送信データ + 受信データ
+*/
+#define REC_HEAD	14						// 記録の先頭部の長さ
+#define REC_FILE_HEAD	(8+S_NUM)			// ファイルの先頭部の長さ
+struct rec_out {
+	FILE *fp;								// 記録ファイル (NULL:最初の記録で開く)
+	uint64_t t0;							// 記録の開始時刻[ns]
+	char path[S_PATH];						// 保存先 (空:既定)
+};
+struct rec_in {
+	char name[S_NUM];						// 記録時のバス名
+	byte *buf;								// 記録ファイルの内容
+	uint32_t *pos;							// 各記録の buf 内の位置
+	uint32_t n;								// 記録数
+	uint32_t next;							// 次に照合する記録
+	byte timed;								// 1:記録時の所要時間を待つ
+	uint32_t calls, skip, miss;				// 再生した呼出し、飛ばした記録、一致なし
+};
+
+static void _rec_open(i2c_bus *b){
+	const char *env=getenv("SOFT_I2C_RECORD");
+	if(!env || !env[0] || !strcmp(env,"0") || b->rec) return;
+	b->rec=(struct rec_out *)malloc(sizeof(struct rec_out));
+	if(!b->rec){
+		_bus_error(b,"i2c_record / malloc Error");
+		return;
+	}
+	b->rec->fp=NULL;
+	b->rec->path[0]='\0';
+	if(b==&_bus0 && env[0]=='/') snprintf(b->rec->path,S_PATH,"%s",env);
+	b->rec->t0=_now_ns();
+}
+
+static void _rec_close(i2c_bus *b){
+	if(!b->rec) return;
+	if(b->rec->fp) fclose(b->rec->fp);
+	free(b->rec);
+	b->rec=NULL;
+}
+
+static void _rec_put32(byte *p, uint32_t v){
+	p[0]=(byte)v; p[1]=(byte)(v>>8); p[2]=(byte)(v>>16); p[3]=(byte)(v>>24);
+}
+
+static uint32_t _rec_get32(const byte *p){
+	return (uint32_t)p[0] | (uint32_t)p[1]<<8 | (uint32_t)p[2]<<16 | (uint32_t)p[3]<<24;
+}
+
+static void _rec_write(i2c_bus *b, byte op, byte adr, const byte *tx, byte txlen,
+	const byte *rx, byte rxlen, byte ret, uint64_t t, uint64_t dt){
+// t:開始時刻[ns] dt:所要時間[ns]
+	struct rec_out *r=b->rec;
+	char path[S_PATH], name[S_NUM];
+	byte h[REC_HEAD];
+	if(!r->fp){								// 保存先はバスの方式が決まってから決める
+		if(r->path[0]) snprintf(path,S_PATH,"%s",r->path);
+		else snprintf(path,S_PATH,"%s/soft_i2c_%s.rec",RECORD_DIR,i2c_bus_name_ex(b));
+		r->fp=fopen(path,"w");
+		if(!r->fp){
+			_bus_error(b,"i2c_record / open Error");
+			_rec_close(b);
+			return;
+		}
+		memset(name,0,S_NUM);
+		snprintf(name,S_NUM,"%s",i2c_bus_name_ex(b));
+		fwrite(RECORD_MAGIC,1,8,r->fp);
+		fwrite(name,1,S_NUM,r->fp);
+	}
+	h[0]=op; h[1]=adr&0x7F; h[2]=ret; h[3]=ret ? 0 : b->nack;
+	h[4]=txlen; h[5]=rxlen;
+	_rec_put32(&h[6],(uint32_t)((t-r->t0)/1000));
+	_rec_put32(&h[10],(uint32_t)(dt/1000));
+	fwrite(h,1,REC_HEAD,r->fp);
+	if(txlen) fwrite(tx,1,txlen,r->fp);
+	if(rxlen) fwrite(rx,1,rxlen,r->fp);
+}
+
+static void _rec_add(i2c_bus *b, byte op, byte adr, const byte *tx, byte txlen, const byte *rx, byte rxlen, byte ret){
+// i2c_check/read/write/write_read の結果を記録する(_stats_end の前に呼ぶ)
+	if(b->stats_depth!=1) return;			// 入れ子の呼出しは外側で記録
+	_rec_write(b,op,adr,tx,txlen,rx,rxlen,ret,b->stats_t0,_now_ns()-b->stats_t0);
+}
+
+static byte _replay_open(i2c_bus *b){
+// 記録ファイルを読み込む 戻り値：０の時はエラー
+	const char *env=getenv("SOFT_I2C_REPLAY");
+	char path[S_PATH];
+	struct rec_in *r;
+	FILE *fp;
+	long size;
+	uint32_t p,n;
+	if(env && env[0]) snprintf(path,S_PATH,"%s",env);
+	else snprintf(path,S_PATH,"%s/soft_i2c_gpio%d.rec",RECORD_DIR,b->sda);
+	fp=fopen(path,"r");
+	if(fp==NULL) return 0;
+	r=(struct rec_in *)calloc(1,sizeof(struct rec_in));
+	if(r==NULL || fseek(fp,0,SEEK_END) || (size=ftell(fp))<REC_FILE_HEAD || fseek(fp,0,SEEK_SET) ||
+		(r->buf=(byte *)malloc(size))==NULL || fread(r->buf,1,size,fp)!=(size_t)size ||
+		memcmp(r->buf,RECORD_MAGIC,8)){
+		fclose(fp);
+		if(r) free(r->buf);
+		free(r);
+		return 0;
+	}
+	fclose(fp);
+	memcpy(r->name,&r->buf[8],S_NUM);
+	r->name[S_NUM-1]='\0';
+	for(n=0,p=REC_FILE_HEAD;p+REC_HEAD<=(uint32_t)size;n++) p+=REC_HEAD+r->buf[p+4]+r->buf[p+5];
+	if(p>(uint32_t)size) n--;				// 途中で切れた最後の記録は使わない
+	r->pos=(uint32_t *)malloc((n ? n : 1)*sizeof(uint32_t));
+	if(r->pos==NULL || n==0){
+		free(r->pos);
+		free(r->buf);
+		free(r);
+		return 0;
+	}
+	for(r->n=0,p=REC_FILE_HEAD;r->n<n;r->n++){
+		r->pos[r->n]=p;
+		p+=REC_HEAD+r->buf[p+4]+r->buf[p+5];
+	}
+	env=getenv("SOFT_I2C_REPLAY_TIME");
+	r->timed = env && env[0]=='1';
+	b->replay=r;
+	return 1;
+}
+
+static void _replay_close(i2c_bus *b){
+	struct rec_in *r=b->replay;
+	char s[96];
+	if(!r) return;
+	if(r->skip || r->miss){					// 記録時と異なる呼出しがあった
+		snprintf(s,sizeof(s),"i2c_replay / %u calls, %u records skipped, %u not found",
+			r->calls,r->skip,r->miss);
+		_bus_error(b,s);
+	}
+	free(r->pos);
+	free(r->buf);
+	free(r);
+	b->replay=NULL;
+}
+
+static byte _replay_xfer(i2c_bus *b, byte op, byte adr, const byte *tx, byte txlen, byte *rx, byte rxlen){
+// 命令、アドレス、送信データが一致する次の記録の結果と受信データを返す
+// 戻り値：記録時の戻り値(０の時はエラー)
+	struct rec_in *r=b->replay;
+	const byte *p=NULL;
+	uint32_t i,k=0;
+	char s[64];
+	r->calls++;
+	adr&=0x7F;
+	for(i=0;i<r->n;i++){
+		k=(r->next+i)%r->n;
+		p=&r->buf[r->pos[k]];
+		if(p[0]==op && p[1]==adr && p[4]==txlen && p[5]==rxlen &&
+			(txlen==0 || !memcmp(&p[REC_HEAD],tx,txlen))) break;
+	}
+	if(i==r->n){
+		r->miss++;
+		snprintf(s,sizeof(s),"i2c_replay / no record for %02X (op %d)",adr,op);
+		_bus_error(b,s);
+		return 0;
+	}
+	r->skip+=i;
+	r->next=(k+1)%r->n;
+	if(rxlen) memcpy(rx,&p[REC_HEAD+txlen],rxlen);
+	if(r->timed) _sleep_until(_now_ns()+_rec_get32(&p[10])*1000ull);
+	b->nack=p[3];
+	if(!p[2] && op!=I2CD_CHECK && (op!=I2CD_WRITE || txlen)){	// 他の方式と同じくエラーを表示
+		snprintf(s,sizeof(s),"i2c_replay / recorded error at %02X (op %d)",adr,op);
+		_bus_error(b,s);
+	}
+	return p[2];
+}
+
+static void _dir_path(char *dir, const char *port){
+// .../gpioN/value -> .../gpioN/direction
+	char *p;
+	strncpy(dir,port,S_PATH-12);
+	dir[S_PATH-12]='\0';
+	p=strrchr(dir,'/');
+	if(p) strcpy(p+1,"direction");
+}
+
+static const char *_sysfs_root(void){
+	const char *root=getenv("SOFT_I2C_SYSFS");		// 模擬 sysfs ツリー等を指定可
+	if(root==NULL || root[0]=='\0') root=GPIO_SYSFS;
+	return root;
+}
+
 byte pinMode(char *port, char *mode){
 // 戻り値：０の時はエラー
 	int i=0;
-	char dir[]="/sys/class/gpio/gpio3/direction";
-	         // 0123456789012345678901234567890
-	dir[20]=port[20];
+	char dir[S_PATH];
+	FILE *fgpio;
+	_dir_path(dir,port);
     #ifdef DEBUG
     //	fprintf(stderr,"pinMode %s %s\n",dir,mode);
     #endif
@@ -112,6 +854,8 @@ byte pinMode(char *port, char *mode){
 
 byte digitalRead(char *port){
 // 戻り値：０の時はエラー
+	FILE *fgpio;
+	char buf[S_NUM]="0";
     fgpio = fopen(port, "r");
 	if( fgpio ){
 	    fgets(buf, S_NUM, fgpio);
@@ -125,6 +869,7 @@ byte digitalRead(char *port){
 
 byte digitalWrite(char *port, int value){
 // 戻り値：０の時はエラー
+	FILE *fgpio;
     fgpio = fopen(port, "w");
 	if( fgpio ){
 	    fprintf(fgpio,"%d\n",value);
@@ -137,304 +882,2052 @@ byte digitalWrite(char *port, int value){
     return 0;
 }
 
+/* GPIO 方式の切換え
+	GPIO_SYSFS_IO	pinMode/digitalRead/digitalWrite で毎回ファイルを開閉する(従来方式)
+	GPIO_FD_IO		i2c_init で value と direction を開き、i2c_close まで
+					pread/pwrite(オフセット0)で読み書きする
+*/
+static int _gpio_fd_open(i2c_bus *b, byte line){
+// 戻り値：０の時はエラー
+	char *port = line ? b->port_scl : b->port_sda;
+	char dir[S_PATH];
+	int i;
+	_dir_path(dir,port);
+	for(i=0;i<GPIO_RETRY;i++){				// export直後は権限設定待ちのためリトライ
+		if(b->fd_val[line]<0) b->fd_val[line]=open(port,O_RDWR);
+		if(b->fd_dir[line]<0) b->fd_dir[line]=open(dir,O_WRONLY);
+		if(b->fd_val[line]>=0 && b->fd_dir[line]>=0) return 1;
+		delay(1);
+	}
+	return 0;
+}
+
+static void _gpio_fd_close(i2c_bus *b){
+	byte line;
+	for(line=0;line<2;line++){
+		if(b->fd_val[line]>=0) close(b->fd_val[line]);
+		if(b->fd_dir[line]>=0) close(b->fd_dir[line]);
+		b->fd_val[line]=-1;
+		b->fd_dir[line]=-1;
+	}
+}
+
+/* GPIO キャラクタデバイス(v2 uAPI)
+	SDA と SCL を1つの line request として取得し、入力(H Imp)と出力(L Out)の
+	切換えを GPIO_V2_LINE_SET_CONFIG_IOCTL の1回で行う(出力値は常にL)。
+*/
+static byte _gpio_chip_open(i2c_bus *b){
+// 戻り値：０の時はエラー
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	struct gpio_v2_line_request req;
+	const char *chip=getenv("SOFT_I2C_GPIOCHIP");
+	int fd;
+	if(chip==NULL || chip[0]=='\0') chip=GPIO_CHIP;
+	fd=open(chip,O_RDWR|O_CLOEXEC);
+	if(fd<0) return 0;
+	memset(&req,0,sizeof(req));
+	req.offsets[LINE_SDA]=b->sda;
+	req.offsets[LINE_SCL]=b->scl;
+	req.num_lines=2;
+	req.config.flags=GPIO_V2_LINE_FLAG_INPUT;	// H Imp から開始
+	strncpy(req.consumer,"soft_i2c",GPIO_MAX_NAME_SIZE-1);
+	if(ioctl(fd,GPIO_V2_GET_LINE_IOCTL,&req)<0) req.fd=-1;
+	close(fd);
+	b->chip_fd=req.fd;
+	b->chip_out=0;
+	return b->chip_fd>=0;
+#else
+	return 0;
+#endif
+}
+
+static void _gpio_chip_close(i2c_bus *b){
+	if(b->chip_fd>=0) close(b->chip_fd);
+	b->chip_fd=-1;
+}
+
+static byte _gpio_chip_mode(i2c_bus *b, byte line, byte out){
+// 戻り値：０の時はエラー
+#ifdef GPIO_V2_LINE_SET_CONFIG_IOCTL
+	struct gpio_v2_line_config cfg;
+	byte mask = out ? (b->chip_out | (1<<line)) : (b->chip_out & ~(1<<line));
+	memset(&cfg,0,sizeof(cfg));
+	cfg.flags=GPIO_V2_LINE_FLAG_INPUT;
+	if(mask){
+		cfg.num_attrs=2;
+		cfg.attrs[0].attr.id=GPIO_V2_LINE_ATTR_ID_FLAGS;
+		cfg.attrs[0].attr.flags=GPIO_V2_LINE_FLAG_OUTPUT;
+		cfg.attrs[0].mask=mask;
+		cfg.attrs[1].attr.id=GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		cfg.attrs[1].attr.values=0;				// 出力時は常に L
+		cfg.attrs[1].mask=mask;
+	}
+	if(ioctl(b->chip_fd,GPIO_V2_LINE_SET_CONFIG_IOCTL,&cfg)<0) return 0;
+	b->chip_out=mask;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static byte _gpio_chip_read(i2c_bus *b, byte line){
+#ifdef GPIO_V2_LINE_GET_VALUES_IOCTL
+	struct gpio_v2_line_values val;
+	val.bits=0;
+	val.mask=1<<line;
+	if(ioctl(b->chip_fd,GPIO_V2_LINE_GET_VALUES_IOCTL,&val)<0) return 0;
+	return (byte)((val.bits>>line)&1);
+#else
+	return 0;
+#endif
+}
+
+static byte _gpio_chip_write(i2c_bus *b, byte line, int value){
+// 戻り値：０の時はエラー
+#ifdef GPIO_V2_LINE_SET_VALUES_IOCTL
+	struct gpio_v2_line_values val;
+	if( !value && (b->chip_out & (1<<line)) ) return 1;	// 出力設定時にLを設定済み
+	val.bits=value ? (1<<line) : 0;
+	val.mask=1<<line;
+	return ioctl(b->chip_fd,GPIO_V2_LINE_SET_VALUES_IOCTL,&val)>=0;
+#else
+	return 0;
+#endif
+}
+
+/* GPIO レジスタ直接操作(BCM283x)
+	GPFSEL で入力(H Imp)と出力を切り換え、出力値は GPCLR で常にLにしておく。
+	入力は GPLEV を読む。レジスタ操作にシステムコールは不要。
+	/dev/gpiomem が無いときは同じ配置の通常ファイルを mmap し、GPLEV を
+	プルアップされたオープンドレインのバス(スレーブなし)として模擬する。
+*/
+static void _gpio_map_lock(void){
+// GPFSEL は10ピンで1レジスタのため、他のバス(スレッド)と読み書きが重ならないようにする
+	while(__sync_lock_test_and_set(&_fsel_lock,1)) ;
+}
+
+static void _gpio_map_unlock(void){
+	__sync_lock_release(&_fsel_lock);
+}
+
+static void _gpio_map_sim_lev(i2c_bus *b){
+	uint32_t low[2]={0,0};
+	int pin;
+	for(pin=0;pin<54;pin++){
+		if( ((b->map[GPFSEL0+pin/10]>>((pin%10)*3))&7)==1 &&	// 出力
+			(b->map[GPCLR0+pin/32]&(1u<<(pin%32))) ) low[pin/32] |= 1u<<(pin%32);	// Lを出力中
+	}
+	b->map[GPLEV0] = ~low[0];
+	b->map[GPLEV0+1] = ~low[1];
+}
+
+static byte _gpio_map_mode(i2c_bus *b, byte line, byte out){
+	int pin = line ? b->scl : b->sda;
+	volatile uint32_t *fsel = &b->map[GPFSEL0 + pin/10];
+	int shift = (pin%10)*3;
+	_gpio_map_lock();
+	*fsel = (*fsel & ~(7u<<shift)) | ((uint32_t)(out ? 1 : 0)<<shift);
+	if(b->map_sim) _gpio_map_sim_lev(b);
+	_gpio_map_unlock();
+	return 1;
+}
+
+static byte _gpio_map_read(i2c_bus *b, byte line){
+	int pin = line ? b->scl : b->sda;
+	return (byte)((b->map[GPLEV0+pin/32]>>(pin%32))&1);
+}
+
+static void _gpio_map_pin_write(i2c_bus *b, int pin, int value){
+	uint32_t bit = 1u<<(pin%32);
+	if(b->map_sim){						// 模擬時は GPCLR0 を出力値Lのラッチとして使う
+		_gpio_map_lock();
+		if(value) b->map[GPCLR0+pin/32] &= ~bit;
+		else b->map[GPCLR0+pin/32] |= bit;
+		_gpio_map_sim_lev(b);
+		_gpio_map_unlock();
+	}else if(value) b->map[GPSET0+pin/32] = bit;
+	else b->map[GPCLR0+pin/32] = bit;
+}
+
+static byte _gpio_map_write(i2c_bus *b, byte line, int value){
+	_gpio_map_pin_write(b, line ? b->scl : b->sda, value);
+	return 1;
+}
+
+static byte _gpio_map_open(i2c_bus *b){
+// 戻り値：０の時はエラー
+	const char *mem=getenv("SOFT_I2C_GPIOMEM");
+	struct stat st;
+	void *map;
+	int fd,i;
+	if(mem==NULL || mem[0]=='\0') mem=GPIO_MEM;
+	fd=open(mem,O_RDWR|O_SYNC|O_CLOEXEC);
+	if(fd<0 && errno==ENOENT){				// デバイスが無いときのみ模擬レジスタファイル
+		if(!strcmp(mem,GPIO_MEM)){			// (権限なし等は実バスなので fd 方式へ)
+			_bus_error(b,"I2C_Init / " GPIO_MEM " not found (simulated by " GPIO_MEM_SIM ")");
+			mem=GPIO_MEM_SIM;
+		}
+		fd=open(mem,O_RDWR|O_CREAT|O_NOFOLLOW|O_CLOEXEC,0644);	// /tmp のリンクはたどらない
+	}
+	if(fd<0) return 0;
+	if(fstat(fd,&st)<0){
+		close(fd);
+		return 0;
+	}
+	b->map_sim=S_ISREG(st.st_mode);
+	if(b->map_sim && st.st_size<GPIO_MEM_SIZE && ftruncate(fd,GPIO_MEM_SIZE)<0){
+		close(fd);
+		return 0;
+	}
+	map=mmap(NULL,GPIO_MEM_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if(map==MAP_FAILED) return 0;
+	b->map=(volatile uint32_t *)map;
+	for(i=0;i<b->lanes;i++) _gpio_map_pin_write(b,b->lane_sda[i],LOW);	// 出力値をLに
+	_gpio_map_write(b,LINE_SCL,LOW);
+	return 1;
+}
+
+static void _gpio_map_close(i2c_bus *b){
+	if(b->map) munmap((void *)b->map,GPIO_MEM_SIZE);
+	b->map=NULL;
+}
+
+static byte _lanes_all(i2c_bus *b){
+	return (byte)((1u<<b->lanes)-1);
+}
+
+static void _lanes_sda(i2c_bus *b, byte hi){
+// hi のビットのレーンを入力(H Imp)、その他を出力(L)にする
+	uint32_t fmask[6]={0,0,0,0,0,0}, fout[6]={0,0,0,0,0,0};
+	uint64_t t_io = b->trace ? _now_ns() : 0;
+	int i,pin,r;
+	for(i=0;i<b->lanes;i++){
+		pin=b->lane_sda[i];
+		fmask[pin/10] |= 7u<<((pin%10)*3);
+		if( !((hi>>i)&1) ) fout[pin/10] |= 1u<<((pin%10)*3);
+	}
+	_gpio_map_lock();
+	for(r=0;r<6;r++) if(fmask[r]){
+		b->map[GPFSEL0+r] = (b->map[GPFSEL0+r] & ~fmask[r]) | fout[r];
+	}
+	if(b->map_sim) _gpio_map_sim_lev(b);
+	_gpio_map_unlock();
+	b->line_dir[LINE_SDA] = (hi&1) ? 0 : 1;	// レーン0は SDA
+	b->io_n++;
+	if(b->trace) _trace_add(b,TRACE_LANES,hi,t_io);
+	_delayNanoseconds(b,b->ramda);
+}
+
+/* ハードウェアI2C (i2c-dev)
+	i2c_check/i2c_read/i2c_write を /dev/i2c-N の I2C_RDWR に置き換える。
+	アドレスは7ビットのまま渡す。開けないときはビットバングで動作する。
+*/
+static byte _i2c_dev_open(i2c_bus *b){
+// 戻り値：０の時はエラー
+	const char *dev=getenv("SOFT_I2C_DEV");
+	unsigned long funcs=0;
+	if(dev==NULL || dev[0]=='\0') dev=I2C_DEV;
+	b->dev_fd=open(dev,O_RDWR|O_CLOEXEC);
+	if(b->dev_fd<0) return 0;
+	if(ioctl(b->dev_fd,I2C_FUNCS,&funcs)<0 || !(funcs & I2C_FUNC_I2C)){
+		close(b->dev_fd);				// I2C_RDWR 非対応(SMBusのみ)
+		b->dev_fd=-1;
+		return 0;
+	}
+	return 1;
+}
+
+static void _i2c_dev_close(i2c_bus *b){
+	if(b->dev_fd>=0) close(b->dev_fd);
+	b->dev_fd=-1;
+}
+
+static byte _i2c_dev_xfer(i2c_bus *b, byte adr, uint16_t flags, byte *data, byte len){
+// 戻り値：０の時はエラー
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data rdwr;
+	msg.addr=adr;
+	msg.flags=flags;
+	msg.len=len;
+	msg.buf=data;
+	rdwr.msgs=&msg;
+	rdwr.nmsgs=1;
+	if( ioctl(b->dev_fd,I2C_RDWR,&rdwr)==1 ) return 1;
+	if(errno==ENXIO || errno==EREMOTEIO) b->nack=STATS_NACK_ADR;	// 統計用(データの NACK とは区別できない)
+	return 0;
+}
+
+/* i2cd デーモン経由 (libs/i2cd.h)
+	i2c_check/i2c_read/i2c_write/i2c_write_read を、バスを初期化済みのまま
+	保持しているデーモンへの要求に置き換える。GPIO の準備や export は不要。
+*/
+static byte _i2cd_open(i2c_bus *b){
+// 戻り値：０の時はエラー
+	const char *sock=getenv("SOFT_I2C_I2CD");
+	struct sockaddr_un sa;
+	if(sock==NULL || sock[0]=='\0') sock=I2CD_SOCK;
+	memset(&sa,0,sizeof(sa));
+	sa.sun_family=AF_UNIX;
+	snprintf(sa.sun_path,sizeof(sa.sun_path),"%s",sock);
+	b->i2cd_fd=socket(AF_UNIX,SOCK_SEQPACKET|SOCK_CLOEXEC,0);
+	if(b->i2cd_fd<0) return 0;
+	if(connect(b->i2cd_fd,(struct sockaddr *)&sa,sizeof(sa))<0){
+		close(b->i2cd_fd);
+		b->i2cd_fd=-1;
+		return 0;
+	}
+	return 1;
+}
+
+static void _i2cd_close(i2c_bus *b){
+	if(b->i2cd_fd>=0) close(b->i2cd_fd);
+	b->i2cd_fd=-1;
+}
+
+static byte _i2cd_xfer(i2c_bus *b, byte op, byte adr, const byte *tx, byte txlen, byte *rx, byte rxlen){
+// 1命令の要求を送り応答を待つ 戻り値：デーモン側の関数の戻り値(０の時はエラー)
+	byte buf[1+I2CD_OP_HEAD+255+1];
+	ssize_t len;
+	buf[0]=1;								// 命令数
+	buf[1]=op;
+	buf[2]=adr;
+	buf[3]=txlen;
+	buf[4]=rxlen;
+	if(txlen) memcpy(&buf[1+I2CD_OP_HEAD],tx,txlen);
+	if( send(b->i2cd_fd,buf,1+I2CD_OP_HEAD+txlen,0)<0 ||
+		(len=recv(b->i2cd_fd,buf,sizeof(buf),0)) != 1+rxlen ){
+		_bus_error(b,"i2cd / connection Error");
+		return 0;
+	}
+	if(rxlen) memcpy(rx,&buf[1],rxlen);
+	return buf[0];
+}
+
+/* 模擬バス (libs/i2c_sim.c)
+	i2c_check/i2c_read/i2c_write/i2c_write_read をデバイスモデルとの通信に置き換える。
+	シンボル長から求めたビット数分の時間とデバイスのクロックストレッチを待つ。
+	SDA の固着は通信の開始時に検出し、i2c_start と同様に i2c_recover で復旧する。
+*/
+static byte _i2c_sim_xfer(i2c_bus *b, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen){
+// rx が NULL の時は送信のみ 戻り値：０の時はエラー
+	uint32_t bits=9u*(1+txlen) + (rx ? 9u*((txlen>0)+rxlen) : 0) + 2;	// アドレス、データ、START/STOP
+	uint32_t stretch_us;
+	int r;
+	r=i2c_sim_xfer(adr,tx,txlen,rx,rxlen,&stretch_us);
+	if(r==I2C_SIM_STUCK){
+		_stats_add(b,offsetof(stats_adr,start_lock));
+		if(!i2c_recover_ex(b)) return 0;
+		r=i2c_sim_xfer(adr,tx,txlen,rx,rxlen,&stretch_us);
+	}
+	if(b->stretch_ms && stretch_us > b->stretch_ms*1000){
+		stretch_us=b->stretch_ms*1000;
+		_bus_error(b,"i2c_SCL / Clock Line Holded");
+		r=I2C_SIM_STUCK;
+	}
+	_sleep_until(_now_ns() + (uint64_t)bits*3*b->ramda_def + stretch_us*1000ull);
+	b->stretch_ns+=stretch_us*1000ull;
+	if(r==I2C_SIM_NACK_ADR) b->nack=STATS_NACK_ADR;
+	if(r==I2C_SIM_NACK_DATA) b->nack=STATS_NACK_DATA;
+	if(r==I2C_SIM_OK) return 1;
+	return r!=I2C_SIM_STUCK && !b->error_check;	// ACK を無視する設定
+}
+
+static byte _gpio_mode(i2c_bus *b, byte line, char *mode){
+// 戻り値：０の時はエラー
+	int len;
+	if(b->backend==GPIO_FD_IO){
+		len=strlen(mode);
+		return pwrite(b->fd_dir[line],mode,len,0)==len;
+	}
+	if(b->backend==GPIO_CHIP_IO) return _gpio_chip_mode(b,line,mode[0]=='o');
+	if(b->backend==GPIO_MMAP_IO) return _gpio_map_mode(b,line,mode[0]=='o');
+	return pinMode(line ? b->port_scl : b->port_sda, mode);
+}
+
+static byte _gpio_read_io(i2c_bus *b, byte line){
+	char c='0';
+	if(b->backend==GPIO_FD_IO){
+		if(pread(b->fd_val[line],&c,1,0)!=1) return 0;
+		return (byte)(c=='1');
+	}
+	if(b->backend==GPIO_CHIP_IO) return _gpio_chip_read(b,line);
+	if(b->backend==GPIO_MMAP_IO) return _gpio_map_read(b,line);
+	return digitalRead(line ? b->port_scl : b->port_sda);
+}
+
+static byte _gpio_read(i2c_bus *b, byte line){
+	uint64_t t_io;
+	byte v;
+	if(!b->trace) return _gpio_read_io(b,line);
+	t_io=_now_ns();
+	v=_gpio_read_io(b,line);
+	_trace_add(b,TRACE_SDA_IN+line,v,t_io);
+	return v;
+}
+
+static byte _gpio_write(i2c_bus *b, byte line, int value){
+// 戻り値：０の時はエラー
+	if(b->backend==GPIO_FD_IO){
+		return pwrite(b->fd_val[line],value ? "1\n" : "0\n",2,0)==2;
+	}
+	if(b->backend==GPIO_CHIP_IO) return _gpio_chip_write(b,line,value);
+	if(b->backend==GPIO_MMAP_IO) return _gpio_map_write(b,line,value);
+	return digitalWrite(line ? b->port_scl : b->port_sda, value);
+}
+
+const char *i2c_bus_name_ex(i2c_bus *b){
+// バスの識別名(キャッシュ等のキー) 例:gpio2(SDAのGPIO番号) i2c-1
+	const char *dev=getenv("SOFT_I2C_DEV");
+	if(b->backend==I2C_DEV_IO){
+		if(dev==NULL || dev[0]=='\0') dev=I2C_DEV;
+		if(strrchr(dev,'/')) dev=strrchr(dev,'/')+1;
+		snprintf(b->name,S_NUM,"%s",dev);
+	}else if(b->backend==I2C_SIM_IO) snprintf(b->name,S_NUM,"sim");
+	else if(b->backend==I2C_REPLAY_IO) snprintf(b->name,S_NUM,"%s",b->replay ? b->replay->name : "replay");
+	else snprintf(b->name,S_NUM,"gpio%d",b->sda);
+	return b->name;
+}
+
+const char *i2c_backend_name_ex(i2c_bus *b){
+	if(b->backend==GPIO_FD_IO) return "fd";
+	if(b->backend==GPIO_CHIP_IO) return "gpiochip";
+	if(b->backend==GPIO_MMAP_IO) return b->map_sim ? "mmap-sim" : "mmap";
+	if(b->backend==I2C_DEV_IO) return "i2cdev";
+	if(b->backend==I2CD_IO) return "i2cd";
+	if(b->backend==I2C_SIM_IO) return "sim";
+	if(b->backend==I2C_REPLAY_IO) return "replay";
+	return "sysfs";
+}
+
+static byte _reset_gpio(int port, int value){
+// リセット用 GPIO を sysfs で直接 L/H 出力する 戻り値：０の時はエラー
+	char path[S_PATH];
+	const char *root=_sysfs_root();
+	FILE *fgpio;
+	snprintf(path,S_PATH,"%s/gpio%d/value",root,port);
+	if( access(path,F_OK) ){				// 未 export の時
+		snprintf(path,S_PATH,"%s/export",root);
+		fgpio = fopen(path,"w");
+		if(fgpio==NULL) return 0;
+		fprintf(fgpio,"%d\n",port);
+		fclose(fgpio);
+		snprintf(path,S_PATH,"%s/gpio%d/value",root,port);
+	}
+	if( !pinMode(path, value ? "high" : "low") ) return 0;	// 方向と出力値を同時に設定
+	return digitalRead(path)==value;
+}
+
 byte i2c_hard_reset(int port){
 	// 戻り値：０の時はエラー
-	FILE *pp;
-	char buf[9];
-	char com[]="/home/pi/RaspberryPi/gpio/raspi_gpo 00 0 &> /dev/null";
-			//	01234567890123456789012345678901234567890123456789012
 	if(port<1 || port>99) return 0;
-	com[36] = '\0';
-	sprintf(com,"%s%2d 0 &> /dev/null",com,port);
 	#ifdef DEBUG
-		printf("%s\n",com);
+		fprintf(stderr,"i2c_hard_reset (%d)\n",port);
 	#endif
-	pp=popen(com,"r");
-	if(pp){
-		fgets(buf,8,pp);
-		pclose(pp);
-		if(buf[0] != '0'){
-			i2c_error("I2C_RESET(L) / IO Settiong Error");
-			return 0;
-		}
+	if( !_reset_gpio(port,0) ){
+		i2c_error("I2C_RESET(L) / IO Settiong Error");
+		return 0;
 	}
 	delay(10);
-	com[36] = '\0';
-	sprintf(com,"%s%2d 1 &> /dev/null",com,port);
-	#ifdef DEBUG
-		printf("%s\n",com);
-	#endif
-	pp=popen(com,"r");
-	if(pp){
-		fgets(buf,8,pp);
-		pclose(pp);
-		if(buf[0] != '1'){
-			i2c_error("I2C_RESET(H) / IO Settiong Error");
-			return 0;
-		}
+	if( !_reset_gpio(port,1) ){
+		i2c_error("I2C_RESET(H) / IO Settiong Error");
+		return 0;
 	}
 	delay(10);
 	return 1;
 }
 
-byte i2c_SCL(byte level){
-// 戻り値：０の時はエラー
-	byte ret=0;
-	if( level ){
-		ret += !pinMode(PORT_SCL, INPUT);
-	}else{
-		ret += !pinMode(PORT_SCL, OUTPUT);
-		ret += !digitalWrite(PORT_SCL, LOW);
+static byte _scl_wait(i2c_bus *b){
+// スレーブが SCL を L に保持(クロックストレッチ)している間、解放を待つ
+// 戻り値：０の時はタイムアウト
+	uint64_t t0, now;
+	if(b->stretch_ms==0) return 1;
+	t0=now=_now_ns();
+	while( _gpio_read(b,LINE_SCL)==0 ){
+		now=_now_ns();
+		if(now-t0 > b->stretch_ms*1000000ull){
+			_bus_error(b,"i2c_SCL / Clock Line Holded");
+			return 0;
+		}
+		if(now-t0 > b->ramda) _sleep_until(now+b->ramda);	// 長いストレッチはシンボル長ごとに確認
 	}
-	_delayMicroseconds(I2C_RAMDA);
-	return !ret;
+	if(now!=t0){
+		b->deadline=now;					// 解放された時点から H の期間を数える
+		b->stretch_ns+=now-t0;
+	}
+	return 1;
 }
 
-byte i2c_SDA(byte level){
-// 戻り値：０の時はエラー
+/* オープンドレインの模擬
+	出力値は最初に1回だけLに設定し(sysfs, gpiochip, GPIO レジスタとも
+	方向を入力に戻してもLが保持される)、以降は方向の切り換えのみで H Imp と L を
+	作る。設定済みの方向と同じ状態への操作は省略し、回数を io_skip に数える。
+	方向の設定に失敗したときは状態を不明に戻し、次回は必ず設定する。
+*/
+static void _line_reset(i2c_bus *b){
+	b->line_dir[LINE_SDA]=b->line_dir[LINE_SCL]=-1;
+	b->line_low[LINE_SDA]=b->line_low[LINE_SCL]=0;
+}
+
+static byte _line_set(i2c_bus *b, byte line, byte level){
+// 戻り値：０の時はエラー
+	signed char dir = level ? 0 : 1;
+	uint64_t t_io=0;
+	if(b->line_dir[line]==dir){
+		b->io_skip += (level || b->line_low[line]) ? 1 : 2;
+		return 1;
+	}
+	if(b->trace) t_io=_now_ns();
+	b->io_n++;
+	if( !_gpio_mode(b,line, level ? INPUT : OUTPUT) ){
+		b->line_dir[line]=-1;
+		return 0;
+	}
+	b->line_dir[line]=dir;
+	if(!level && b->line_low[line]) b->io_skip++;
+	else if(!level){
+		b->io_n++;
+		if( !_gpio_write(b,line, LOW) ) return 0;
+		b->line_low[line]=1;
+	}
+	if(b->trace) _trace_add(b,TRACE_SDA+line,level,t_io);
+	return 1;
+}
+
+uint32_t i2c_io_stats_ex(i2c_bus *b, uint32_t *elided){
+// 実行した GPIO 操作の回数(戻り値)と省略した回数 (i2c_init でリセット)
+	if(elided) *elided=b->io_skip;
+	return b->io_n;
+}
+
+byte i2c_SCL_ex(i2c_bus *b, byte level){
+// 戻り値：０の時はエラー
 	byte ret=0;
 	if( level ){
-		ret += !pinMode(PORT_SDA, INPUT);
+		ret += !_line_set(b,LINE_SCL, 1);
+		ret += !_scl_wait(b);
+		_scl_edge(b);
 	}else{
-		ret += !pinMode(PORT_SDA, OUTPUT);
-		ret += !digitalWrite(PORT_SDA, LOW);
+		ret += !_line_set(b,LINE_SCL, 0);
 	}
-	_delayMicroseconds(I2C_RAMDA);
+	_delayNanoseconds(b,b->ramda);
+	return !ret;
+}
+
+byte i2c_SDA_ex(i2c_bus *b, byte level){
+// 戻り値：０の時はエラー
+	byte ret=0;
+	ret += !_line_set(b,LINE_SDA, level);
+	_delayNanoseconds(b,b->ramda);
 	return !ret;
 }
 
-byte i2c_tx(const byte in){
-// 戻り値：０の時はエラー
+byte i2c_tx_ex(i2c_bus *b, const byte in){
+// 戻り値：０の時はエラー
+	int i;
+    #ifdef DEBUG
+    	char s[32];
+		sprintf(s,"tx data = [%02X]",in);
+		i2c_log(s);
+    #endif
+	for(i=0;i<8;i++){
+		if( (in>>(7-i))&0x01 ){
+				i2c_SDA_ex(b,1);			// (SDA)	H Imp
+		}else	i2c_SDA_ex(b,0);			// (SDA)	L Out
+		/*Clock*/
+		if( !i2c_SCL_ex(b,1) ) return 0;	// (SCL)	H Imp (ストレッチ待ちのタイムアウト)
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
+	}
+	/* ACK処理 */
+	_delayNanoseconds(b,b->ramda);
+	i2c_SDA_ex(b,1);						// (SDA)	H Imp  2016/6/26 先にSDAを終わらせる
+	if( !i2c_SCL_ex(b,1) ) return 0;		// (SCL)	H Imp
+	for(i=3;i>0;i--){						// さらにクロックを上げた瞬間には確定しているハズ
+		if( _gpio_read(b,LINE_SDA) == 0 ) break;	// 速やかに確認
+		_delayNanoseconds(b,b->ramda/2);
+	}
+	if(i==0 && b->error_check ){
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
+		i2c_log("no ACK");
+		return 0;
+	}
+    #ifdef DEBUG
+    //	fprintf(stderr,"i2c_tx / GPIO_RETRY (%d/%d)\n",GPIO_RETRY-i,GPIO_RETRY);
+    #endif
+	return (byte)i;
+}
+
+static void _i2c_stop(i2c_bus *b){
+	/* STOP */
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	i2c_SDA_ex(b,0);						// (SDA)	L Out
+	_delayNanoseconds(b,b->ramda);
+	i2c_SCL_ex(b,1);						// (SCL)	H Imp
+	_delayNanoseconds(b,b->ramda);
+	i2c_SDA_ex(b,1);						// (SDA)	H Imp
+}
+
+byte i2c_recover_ex(i2c_bus *b){
+// SDA(または SCL)が L に保持されたバスを復旧する
+// SDA が解放されるまで SCL を最大9回クロックして STOP を出し、それでも
+// 解放されないときは環境変数 SOFT_I2C_RESET の GPIO でデバイスをリセットする
+// 戻り値：０の時は復旧できなかった
+	uint64_t t0=_now_ns(), t;
+	byte quiet=b->quiet;
+	byte ok;
+	int i;
+	char s[64];
+
+	b->quiet=1;							// 保持中のストレッチ待ちは個別に表示しない
+	if(b->backend==I2C_SIM_IO) ok=(byte)i2c_sim_recover(&i);
+	else{
+		i2c_SDA_ex(b,1);					// (SDA)	H Imp
+		for(i=0;i<9 && _gpio_read(b,LINE_SDA)==0;i++){
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+			i2c_SCL_ex(b,1);				// (SCL)	H Imp
+		}
+		_i2c_stop(b);
+		ok = _gpio_read(b,LINE_SCL)==1 && _gpio_read(b,LINE_SDA)==1;
+	}
+	if( !ok && b->backend!=I2C_SIM_IO && b->reset_port>0 && i2c_hard_reset(b->reset_port) ){
+		b->mux_adr=0;						// リセットで TCA9548A の選択も解除される
+		i2c_SDA_ex(b,1);					// (SDA)	H Imp
+		i2c_SCL_ex(b,1);					// (SCL)	H Imp
+		ok = _gpio_read(b,LINE_SCL)==1 && _gpio_read(b,LINE_SDA)==1;
+	}
+	b->quiet=quiet;
+	t=_now_ns()-t0;
+	_stats_add(b,offsetof(stats_adr,recover));
+	b->recover_n++;
+	if(!ok) b->recover_fail++;
+	b->recover_sum += t;
+	if(t>b->recover_max) b->recover_max=t;
+	snprintf(s,sizeof(s),"i2c_recover / %s in %u us (%d clocks)",
+		ok ? "recovered" : "failed", (unsigned)(t/1000), i);
+	_bus_error(b,s);
+	return ok;
+}
+
+uint32_t i2c_recover_stats_ex(i2c_bus *b, uint32_t *failed, double *avg_us, double *max_us){
+// バス復旧の回数(戻り値)、失敗回数、復旧に要した平均と最大の時間[us]
+	if(failed) *failed=b->recover_fail;
+	if(avg_us) *avg_us = b->recover_n ? b->recover_sum/1000./b->recover_n : 0.;
+	if(max_us) *max_us = b->recover_max/1000.;
+	return b->recover_n;
+}
+
+static void _ramda_select(i2c_bus *b, byte adr){
+// 通信先アドレスのシンボル長を選択する(自動調整済みのアドレスは短くなる)
+	b->ramda = (adr<128 && b->ramda_adr[adr]) ? b->ramda_adr[adr] : b->ramda_def;
+}
+
+static const char *_timing_path(i2c_bus *b, char *path){
+	const char *env=getenv("SOFT_I2C_TIMING");		// 既定のバスのみ
+	if(b==&_bus0 && env && env[0]) return env;
+	snprintf(path,S_PATH,"%s/soft_i2c_%s.timing",TIMING_DIR,i2c_bus_name_ex(b));
+	return path;
+}
+
+static void _timing_load(i2c_bus *b){
+// 保存したアドレス別シンボル長を読み込む(ファイルが無いときは全て既定値)
+	FILE *fp;
+	char path[S_PATH];
+	unsigned int adr,ns;
+	memset(b->ramda_adr,0,sizeof(b->ramda_adr));
+	fp=fopen(_timing_path(b,path),"r");
+	if(fp==NULL) return;
+	while(fscanf(fp,"%x %u",&adr,&ns)==2){
+		if(adr<128 && ns>=RAMDA_MIN) b->ramda_adr[adr]=ns;
+	}
+	fclose(fp);
+}
+
+/* プロセス間のバスのロック
+	i2c_init で取得し i2c_close で解放する。ロックファイルに待ち行列(PID)を置き、
+	先頭のプロセスがバスを使用する(到着順)。ファイルの読み書きは flock で排他し、
+	終了したプロセスは待ち行列から取り除く。
+	ロックファイルは SDA の GPIO 番号ごと(方式によらず同じピンなら同じファイル)。
+*/
+static int _pid_alive(pid_t pid){
+// 戻り値：1 実行中のプロセス (終了して回収待ちのプロセスは 0)
+	char path[S_PATH];
+	char buf[S_PATH];
+	char *p;
+	FILE *fp;
+	if(kill(pid,0)<0 && errno==ESRCH) return 0;
+	snprintf(path,S_PATH,"/proc/%d/stat",(int)pid);
+	fp=fopen(path,"r");
+	if(fp==NULL) return 1;					// /proc が無いときは kill の結果のみ
+	p=fgets(buf,sizeof(buf),fp);
+	fclose(fp);
+	if(p) p=strrchr(buf,')');				// "pid (comm) state ..."
+	return !(p && p[1]==' ' && p[2]=='Z');
+}
+
+static int _lock_read(int fd, pid_t *q){
+// 待ち行列を読み込み、終了したプロセスを除く 戻り値：待ち数
+	char buf[LOCK_QUEUE*12+1];
+	char *p,*e;
+	ssize_t len;
+	long pid;
+	int n=0;
+	len=pread(fd,buf,sizeof(buf)-1,0);
+	if(len<0) len=0;
+	buf[len]='\0';
+	for(p=buf;n<LOCK_QUEUE;p=e){
+		pid=strtol(p,&e,10);
+		if(e==p) break;
+		if(pid>0 && _pid_alive((pid_t)pid)) q[n++]=(pid_t)pid;
+	}
+	return n;
+}
+
+static void _lock_write(int fd, const pid_t *q, int n){
+	char buf[LOCK_QUEUE*12+1];
+	int i,len=0;
+	for(i=0;i<n;i++) len+=snprintf(buf+len,sizeof(buf)-len,"%d\n",(int)q[i]);
+	if(ftruncate(fd,0)==0 && len>0 && pwrite(fd,buf,len,0)!=len) i2c_error("i2c_lock / write Error");
+}
+
+static int _lock_update(int fd, pid_t me, int join, int leave){
+// 待ち行列に自分を加える(join)／除く(leave) 戻り値：先頭のとき 1
+	pid_t q[LOCK_QUEUE+1];
+	int i,n,found=0,head;
+	flock(fd,LOCK_EX);
+	n=_lock_read(fd,q);
+	for(i=0;i<n;i++) if(q[i]==me) found=1;
+	if(!found && join && n<LOCK_QUEUE) q[n++]=me;	// ファイルが消された時も加え直す
+	if(leave){
+		for(i=0;i<n && q[i]!=me;i++) ;
+		if(i<n){
+			memmove(&q[i],&q[i+1],(n-i-1)*sizeof(pid_t));
+			n--;
+		}
+	}
+	head = n>0 && q[0]==me;
+	_lock_write(fd,q,n);
+	flock(fd,LOCK_UN);
+	return head;
+}
+
+static byte _bus_lock(i2c_bus *b){
+// 戻り値：０の時はタイムアウト
+	const char *env=getenv("SOFT_I2C_LOCK_MS");
+	uint32_t ms = (env && env[0]) ? (uint32_t)atol(env) : LOCK_MS;
+	char path[S_PATH];
+	char s[80];
+	pid_t me=getpid();
+	uint64_t t0,wait;
+	int fd;
+
+	if(ms==0 || b->lock_fd>=0) return 1;	// ロックしない／取得済み
+	env=getenv("SOFT_I2C_LOCK");
+	if(b==&_bus0 && env && env[0]) snprintf(path,S_PATH,"%s",env);
+	else snprintf(path,S_PATH,"%s/soft_i2c_gpio%d.lock",LOCK_DIR,b->sda);
+	fd=open(path,O_RDWR|O_CLOEXEC);		// 既存のファイルは O_CREAT なしで開く(fs.protected_regular
+	if(fd<0 && errno==ENOENT){				// では /tmp の他のユーザのファイルを O_CREAT で開けない)
+		fd=open(path,O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC,0666);
+		if(fd>=0) fchmod(fd,0666);			// 他のユーザのツールとも共有する
+		else if(errno==EEXIST) fd=open(path,O_RDWR|O_CLOEXEC);	// 同時に作成された
+	}
+	if(fd<0){
+		_bus_error(b,"I2C_Init / lock file open Error (not locked)");
+		return 1;
+	}
+	t0=_now_ns();
+	while( !_lock_update(fd,me,1,0) ){
+		if(_now_ns()-t0 > ms*1000000ull){
+			_lock_update(fd,me,0,1);
+			close(fd);
+			b->lock_timeout++;
+			snprintf(s,sizeof(s),"I2C_Init / bus locked by other process (%u ms)",ms);
+			_bus_error(b,s);
+			return 0;
+		}
+		delay(1);
+	}
+	wait=_now_ns()-t0;
+	b->lock_fd=fd;
+	b->lock_n++;
+	b->lock_sum+=wait;
+	if(wait>b->lock_max) b->lock_max=wait;
+	#ifdef DEBUG
+		snprintf(s,sizeof(s),"i2c_lock / waited %u us",(unsigned)(wait/1000));
+		i2c_log(s);
+	#endif
+	return 1;
+}
+
+static void _bus_unlock(i2c_bus *b){
+	if(b->lock_fd<0) return;
+	_lock_update(b->lock_fd,getpid(),0,1);
+	close(b->lock_fd);
+	b->lock_fd=-1;
+}
+
+uint32_t i2c_lock_stats_ex(i2c_bus *b, uint32_t *timeouts, double *avg_us, double *max_us){
+// ロックの取得回数(戻り値)、タイムアウト回数、ロック待ちの平均と最大の時間[us]
+	if(timeouts) *timeouts=b->lock_timeout;
+	if(avg_us) *avg_us = b->lock_n ? b->lock_sum/1000./b->lock_n : 0.;
+	if(max_us) *max_us = b->lock_max/1000.;
+	return b->lock_n;
+}
+
+static void _bus_setup(i2c_bus *b, int sda, int scl){
+	memset(b,0,sizeof(i2c_bus));
+	b->sda=sda;
+	b->scl=scl;
+	b->lanes=1;
+	b->lane_sda[0]=sda;
+	b->error_check=1;
+	b->backend=SOFT_I2C_BACKEND;
+	snprintf(b->port_sda,S_PATH,"%s/gpio%d/value",GPIO_SYSFS,sda);
+	snprintf(b->port_scl,S_PATH,"%s/gpio%d/value",GPIO_SYSFS,scl);
+	b->fd_val[0]=b->fd_val[1]=-1;
+	b->fd_dir[0]=b->fd_dir[1]=-1;
+	b->chip_fd=-1;
+	b->dev_fd=-1;
+	b->i2cd_fd=-1;
+	b->ramda=b->ramda_def=I2C_RAMDA*1000;
+	b->stretch_ms=STRETCH_MS;
+	b->reset_port=-1;
+	b->lock_fd=-1;
+	b->lcd_x=8;
+	b->lcd_y=2;
+}
+
+i2c_bus *i2c_bus_new(int sda, int scl){
+/*
+SDA と SCL の GPIO 番号を指定してバスを作成する(i2c_init_ex で使用開始)
+戻り値：バス、NULLの時はエラー
+*/
+	i2c_bus *b;
+	if(sda<0 || scl<0 || sda>53 || scl>53 || sda==scl) return NULL;
+	b=malloc(sizeof(i2c_bus));
+	if(b) _bus_setup(b,sda,scl);
+	return b;
+}
+
+i2c_bus *i2c_bus_new_lanes(const int *sda, int lanes, int scl){
+/*
+SCL を共有する複数の SDA (レーン)のバスを作成する(i2c_write_read_lanes 用)
+入力：const int *sda = 各レーンの SDA の GPIO 番号
+入力：int lanes = レーン数 (1～I2C_LANES)
+入力：int scl = 共有する SCL の GPIO 番号
+戻り値：バス、NULLの時はエラー
+SDA と SCL は GPIO0～31 (GPLEV0 の1回の読込みで全レーンを取得)に限る。
+同じ GPFSEL (GPIO 10本ごと)に並べると方向の切換えも1回の書込みになる。
+*/
+	i2c_bus *b;
+	int i,j;
+	if(sda==NULL || lanes<1 || lanes>I2C_LANES || scl<0 || scl>31) return NULL;
+	for(i=0;i<lanes;i++){
+		if(sda[i]<0 || sda[i]>31 || sda[i]==scl) return NULL;
+		for(j=0;j<i;j++) if(sda[j]==sda[i]) return NULL;
+	}
+	b=i2c_bus_new(sda[0],scl);
+	if(b==NULL) return NULL;
+	b->lanes=lanes;
+	for(i=0;i<lanes;i++) b->lane_sda[i]=sda[i];
+	return b;
+}
+
+void i2c_bus_free(i2c_bus *b){
+// i2c_close_ex の後で解放する
+	if(b && b!=&_bus0) free(b);
+}
+
+i2c_bus *i2c_bus_default(void){
+// 従来の i2c_* 関数が使うバス(SDA=GPIO2, SCL=GPIO3)
+	static volatile int st=0;
+	if(_once_begin(&st)){
+		_bus_setup(&_bus0,PORT_SDANUM,PORT_SDANUM+1);
+		_once_end(&st);
+	}
+	return &_bus0;
+}
+
+void i2c_set_error_check_ex(i2c_bus *b, int check){
+// 1:ACKを確認／0:ACKを無視する
+	b->error_check=check;
+	if(b==&_bus0) ERROR_CHECK=check;		// 次の i2c_init でも同じ値に
+}
+
+byte i2c_init_ex(i2c_bus *b){
+// 戻り値：０の時はエラー
+	int i;
+	char path[S_PATH];
+	const char *root=_sysfs_root();
+	const char *env;
+	FILE *fgpio;
+	byte quiet=b->quiet;
+
+	_micros_0();
+	i2c_log("I2C_Init");
+	_spin_calibrate();
+	_speed_env(b);
+	if(b==&_bus0) b->error_check=ERROR_CHECK;	// オプション -i 等で変更された値を反映
+	env=getenv("SOFT_I2C_STRETCH");
+	b->stretch_ms = (env && env[0]) ? (uint32_t)atol(env) : STRETCH_MS;
+	env=getenv("SOFT_I2C_RESET");
+	b->reset_port = (env && env[0]) ? atoi(env) : -1;
+	env=getenv("SOFT_I2C_BACKEND");
+	b->scl_n=0;									// SCL 周期の測定をリセット
+	b->scl_sum=0;
+	b->scl_prev=0;
+	b->io_n=0;									// GPIO 操作の回数をリセット
+	b->io_skip=0;
+	_line_reset(b);
+	b->mux_adr=0;								// 前のプロセスは i2c_close で選択を解除済み
+	b->mux_sel=0;
+	b->mux_skip=0;
+	b->ramda=b->ramda_def;
+	_trace_open(b);							// 保存先(バス名)は i2c_close で決める
+	_rec_open(b);							// 保存先(バス名)は最初の記録で決める
+	b->backend=SOFT_I2C_BACKEND;
+	if(env && env[0]){
+		if(!strcmp(env,"sysfs")) b->backend=GPIO_SYSFS_IO;
+		else if(!strcmp(env,"fd")) b->backend=GPIO_FD_IO;
+		else if(!strcmp(env,"gpiochip")) b->backend=GPIO_CHIP_IO;
+		else if(!strcmp(env,"mmap")) b->backend=GPIO_MMAP_IO;
+		else if(!strcmp(env,"i2cdev")) b->backend=I2C_DEV_IO;
+		else if(!strcmp(env,"i2cd")) b->backend=I2CD_IO;
+		else if(!strcmp(env,"sim")) b->backend=I2C_SIM_IO;
+		else if(!strcmp(env,"replay")) b->backend=I2C_REPLAY_IO;
+		else{
+			snprintf(path,S_PATH,"I2C_Init / unknown SOFT_I2C_BACKEND=%s (sysfs, fd, gpiochip, mmap, i2cdev, i2cd, sim, replay)",env);
+			_bus_error(b,path);
+		}
+	}
+	if(b->backend==I2CD_IO){				// バスはデーモンが保持している(ロック不要)
+		if(_i2cd_open(b)){
+			_stats_open(b);
+			return 1;
+		}
+		_bus_error(b,"I2C_Init / i2cd connect Error (fallback to fd)");
+		b->backend=GPIO_FD_IO;
+	}
+	if(b->backend==I2C_SIM_IO){				// 模擬バスはプロセス内(ロック不要)
+		if(i2c_sim_open()){
+			_stats_open(b);
+			return 1;
+		}
+		_bus_error(b,"I2C_Init / SOFT_I2C_SIM Error (fallback to fd)");
+		b->backend=GPIO_FD_IO;
+	}
+	if(b->backend==I2C_REPLAY_IO){			// 記録の再生はバスを使わない(ロック不要)
+		_rec_close(b);						// 再生中は記録しない(同じバス名の記録を上書きしない)
+		if(_replay_open(b)){
+			_stats_open(b);
+			return 1;
+		}
+		_bus_error(b,"I2C_Init / SOFT_I2C_REPLAY open Error (fallback to fd)");
+		b->backend=GPIO_FD_IO;
+	}
+	if( !_bus_lock(b) ) return 0;			// 他のプロセスの使用中(待ち行列の順番を待つ)
+	if(b->backend==I2C_DEV_IO){
+		if(_i2c_dev_open(b)){
+			_stats_open(b);
+			return 1;
+		}
+		_bus_error(b,"I2C_Init / i2c-dev open Error (fallback to fd)");
+		b->backend=GPIO_FD_IO;
+	}
+	if(b->backend==GPIO_CHIP_IO && !_gpio_chip_open(b)){
+		_bus_error(b,"I2C_Init / gpiochip open Error (fallback to fd)");
+		b->backend=GPIO_FD_IO;
+	}
+	if(b->backend==GPIO_MMAP_IO && !_gpio_map_open(b)){
+		_bus_error(b,"I2C_Init / gpiomem mmap Error (fallback to fd)");
+		b->backend=GPIO_FD_IO;
+	}
+	_timing_load(b);						// 自動調整済みのアドレス別シンボル長
+	snprintf(b->port_sda,S_PATH,"%s/gpio%d/value",root,b->sda);
+	snprintf(b->port_scl,S_PATH,"%s/gpio%d/value",root,b->scl);
+	snprintf(path,S_PATH,"%s/export",root);
+    for(i=0;i<2 && b->backend<=GPIO_FD_IO;i++){	// sysfs の方式のみ export
+		fgpio = fopen(path,"w");
+	    if(fgpio==NULL ){
+	        _bus_error(b,"I2C_Init / IO Settiong Error\n");
+	        printf("9\n");
+	        _bus_unlock(b);
+	        return 0;
+	    }
+	    fprintf(fgpio,"%d\n",i ? b->scl : b->sda);
+	    fclose(fgpio);
+	}
+	if(b->backend==GPIO_FD_IO){
+		if( !_gpio_fd_open(b,LINE_SDA) || !_gpio_fd_open(b,LINE_SCL) ){
+			_bus_error(b,"I2C_Init / fd open Error (fallback to sysfs)");
+			_gpio_fd_close(b);
+			b->backend=GPIO_SYSFS_IO;
+		}
+	}
+	_line_reset(b);							// 方式の切り換え後は方向・出力値とも不明
+	_stats_open(b);
+	b->quiet=1;							// ロック中のストレッチ待ちは個別に表示しない
+	for(i=GPIO_RETRY;i>0;i--){						// リトライ50回まで
+		i2c_SDA_ex(b,1);					// (SDA)	H Imp
+		i2c_SCL_ex(b,1);					// (SCL)	H Imp
+		if( _gpio_read(b,LINE_SCL)==1 &&
+			_gpio_read(b,LINE_SDA)==1  ) break;
+		delay(1);
+	}
+	b->quiet=quiet;
+	if(i==0 && i2c_recover_ex(b)) i=1;		// バスの復旧
+	if(i==0){
+		_bus_error(b,"I2C_Init / Locked Lines");
+		_bus_unlock(b);						// 失敗時はバスを保持しない
+	}
+    #ifdef DEBUG
+    //	fprintf(stderr,"i2c_init / GPIO_RETRY (%d/%d)\n",GPIO_RETRY-i,GPIO_RETRY);
+    #endif
+	_delayNanoseconds(b,b->ramda*8);
+	return (byte)i;
+}
+
+static byte _bus_close(i2c_bus *b){
+	byte i;
+	char path[S_PATH];
+	char s[80];
+	FILE *fgpio;
+	i2c_log("i2c_close");
+	_line_reset(b);
+	if(b->recover_n){						// 不安定なバスの検出用
+		snprintf(s,sizeof(s),"i2c_close / bus recovered %u times (failed %u, max %u us)",
+			b->recover_n,b->recover_fail,(unsigned)(b->recover_max/1000));
+		_bus_error(b,s);
+	}
+	if(b->backend==I2C_DEV_IO){
+		_i2c_dev_close(b);
+		return 1;
+	}
+	if(b->backend==I2CD_IO){
+		_i2cd_close(b);
+		return 1;
+	}
+	if(b->backend==I2C_SIM_IO){
+		i2c_sim_close();
+		return 1;
+	}
+	if(b->backend==I2C_REPLAY_IO){
+		_replay_close(b);
+		return 1;
+	}
+	_gpio_fd_close(b);
+	if(b->backend==GPIO_CHIP_IO){
+		_gpio_chip_close(b);
+		return 1;
+	}
+	if(b->backend==GPIO_MMAP_IO){
+		_lanes_sda(b,_lanes_all(b));		// 入力(H Imp)に戻す
+		_gpio_map_mode(b,LINE_SCL,0);
+		_gpio_map_close(b);
+		return 1;
+	}
+	snprintf(path,S_PATH,"%s/unexport",_sysfs_root());
+    for(i=0;i<2;i++){
+		fgpio = fopen(path,"w");
+	    if(fgpio==NULL ){
+	        fprintf(stderr,"IO Error\n");
+	        printf("9\n");
+	        return 0;
+	    }
+	    fprintf(fgpio,"%d\n",i ? b->scl : b->sda);
+	    fclose(fgpio);
+	}
+	return 1;
+}
+
+byte i2c_close_ex(i2c_bus *b){
+// 戻り値：０の時はエラー
+	byte ret;
+	i2c_mux_select_ex(b,0,0);				// 次のプロセスのためにチャネルの選択を解除
+	if(_stats_dump && b->stats) i2c_stats_print_ex(b);
+	_stats_close(b);
+	_trace_save(b);
+	_rec_close(b);
+	ret=_bus_close(b);
+	_bus_unlock(b);							// 待ち行列の次のプロセスへ
+	return ret;
+}
+
+byte i2c_start_ex(i2c_bus *b){
+// 戻り値：０の時はエラー
+//	if(!i2c_init_ex(b))return(0);				// SDA,SCL  H Out
+	byte i=1;
+
+	i2c_SDA_ex(b,1);						// (SDA)	H Imp
+	i2c_SCL_ex(b,1);						// (SCL)	H Imp
+	if( _gpio_read(b,LINE_SCL)!=1 ||
+		_gpio_read(b,LINE_SDA)!=1  ){
+		_stats_add(b,offsetof(stats_adr,start_lock));
+		i=i2c_recover_ex(b);				// バスの復旧
+	}
+	i2c_log("i2c_start");
+	if(i==0 && b->error_check) _bus_error(b,"i2c_start / Locked Lines");
+	_delayNanoseconds(b,b->ramda*8);
+	i2c_SDA_ex(b,0);						// (SDA)	L Out
+	_delayNanoseconds(b,b->ramda);
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	return i;
+}
+
+static byte _i2c_check(i2c_bus *b, byte adr){
+/*
+入力：byte adr = I2Cアドレス(7ビット)
+戻り値：０の時はエラー
+*/
+	byte ret;
+	if(b->backend==I2C_DEV_IO) return _i2c_dev_xfer(b,adr,0,NULL,0);
+	if(b->backend==I2CD_IO) return _i2cd_xfer(b,I2CD_CHECK,adr,NULL,0,NULL,0);
+	if(b->backend==I2C_SIM_IO) return _i2c_sim_xfer(b,adr,NULL,0,NULL,0);
+	if(b->backend==I2C_REPLAY_IO) return _replay_xfer(b,I2CD_CHECK,adr,NULL,0,NULL,0);
+	_ramda_select(b,adr);
+	if( !i2c_start_ex(b) ) {
+		_bus_error(b,"i2c_check / aborted i2c_start");
+		return 0;
+	}
+	adr <<= 1;								// 7ビット->8ビット
+	adr &= 0xFE;							// RW=0 送信モード
+	ret=i2c_tx_ex(b,adr);
+
+	/* STOP */
+	i2c_SDA_ex(b,0);						// (SDA)	L Out
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	_delayNanoseconds(b,b->ramda);
+	i2c_SCL_ex(b,1);						// (SCL)	H Imp
+	_delayNanoseconds(b,b->ramda);
+	i2c_SDA_ex(b,1);						// (SDA)	H Imp
+	return ret;
+}
+
+byte i2c_check_ex(i2c_bus *b, byte adr){
+	byte ret;
+	_stats_begin(b,adr);
+	ret=_i2c_check(b,adr);
+	if(b->rec) _rec_add(b,I2CD_CHECK,adr,NULL,0,NULL,0,ret);
+	return _stats_end(b,ret,0);
+}
+
+
+static byte _i2c_rx(i2c_bus *b, byte adr, byte *rx, byte len){
+// START(またはRepeated START)後のアドレス送信から受信データまで
+// 戻り値：byte 受信結果長、０の時はエラー
+	byte ret,i;
+
+	adr <<= 1;								// 7ビット->8ビット
+	adr |= 0x01;							// RW=1 受信モード
+	if( i2c_tx_ex(b,adr)==0 && b->error_check ){	// アドレス設定
+		b->nack=STATS_NACK_ADR;
+		_bus_error(b,"I2C_RX / no ACK (Address)");
+		return 0;		
+	}
+	
+	/* スレーブ待機状態待ち */
+	for(i=GPIO_RETRY;i>0;i--){
+		_delayNanoseconds(b,b->ramda);
+		if( _gpio_read(b,LINE_SDA)==0  ) break;
+	}
+	if(i==0 && b->error_check){
+		b->nack=STATS_NACK_DATA;
+		_bus_error(b,"I2C_RX / no ACK (Reading)");
+		return 0;
+	}
+	/* 受信データ */
+	for(ret=0;ret<len;ret++){
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
+		i2c_SDA_ex(b,1);					// (SDA)	H Imp
+		rx[ret]=0x00;
+		for(i=0;i<8;i++){
+			if( !i2c_SCL_ex(b,1) ) return 0;	// (SCL)	H Imp (ストレッチ待ちのタイムアウト)
+			rx[ret] |= (_gpio_read(b,LINE_SDA))<<(7-i);		//data[22] b4=Port 12(SDA)
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+		}
+		if(ret<len-1){
+			// ACKを応答する
+			i2c_SDA_ex(b,0);					// (SDA)	L Out
+			i2c_SCL_ex(b,1);					// (SCL)	H Imp
+			_delayNanoseconds(b,b->ramda);
+		}else{
+			// NACKを応答する
+			i2c_SDA_ex(b,1);					// (SDA)	H Imp
+			i2c_SCL_ex(b,1);					// (SCL)	H Imp
+			_delayNanoseconds(b,b->ramda);
+		}
+	}
+	return ret;
+}
+
+static byte _i2c_read(i2c_bus *b, byte adr, byte *rx, byte len){
+/*
+入力：byte adr = I2Cアドレス(7ビット)
+出力：byte *rx = 受信データ用ポインタ
+入力：byte len = 受信長
+戻り値：byte 受信結果長、０の時はエラー
+*/
+	byte ret;
+	
+	if(b->backend==I2C_DEV_IO){
+		if( len==0 || !_i2c_dev_xfer(b,adr,I2C_M_RD,rx,len) ){
+			_bus_error(b,"I2C_RX / i2c-dev Error");
+			return 0;
+		}
+		return len;
+	}
+	if(b->backend==I2CD_IO) return _i2cd_xfer(b,I2CD_READ,adr,NULL,0,rx,len);
+	if(b->backend==I2C_REPLAY_IO) return _replay_xfer(b,I2CD_READ,adr,NULL,0,rx,len);
+	if(b->backend==I2C_SIM_IO){
+		if( len==0 || !_i2c_sim_xfer(b,adr,NULL,0,rx,len) ){
+			_bus_error(b,"I2C_RX / sim Error");
+			return 0;
+		}
+		return len;
+	}
+	_ramda_select(b,adr);
+	if( !i2c_start_ex(b) && b->error_check) return 0;
+	ret=_i2c_rx(b,adr,rx,len);
+	_i2c_stop(b);
+	return ret;
+}
+
+byte i2c_read_ex(i2c_bus *b, byte adr, byte *rx, byte len){
+	byte ret;
+	_stats_begin(b,adr);
+	ret=_i2c_read(b,adr,rx,len);
+	if(b->rec) _rec_add(b,I2CD_READ,adr,NULL,0,rx,len,ret);
+	return _stats_end(b,ret,ret);
+}
+
+static byte _i2c_write_read(i2c_bus *b, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen){
+/*
+送信後に STOP を出さず Repeated START で受信する(レジスタ読出し用)
+入力：byte adr = I2Cアドレス(7ビット)
+入力：byte *tx = 送信データ用ポインタ(レジスタ番号など)
+入力：byte txlen = 送信データ長
+出力：byte *rx = 受信データ用ポインタ
+入力：byte rxlen = 受信長
+戻り値：byte 受信結果長、０の時はエラー
+*/
+	byte ret;
+	byte wadr;
+	struct i2c_msg msg[2];
+	struct i2c_rdwr_ioctl_data rdwr;
+
+	if(txlen==0) return i2c_read_ex(b,adr,rx,rxlen);
+	if(b->backend==I2C_DEV_IO){
+		msg[0].addr=adr;	msg[0].flags=0;			msg[0].len=txlen;	msg[0].buf=tx;
+		msg[1].addr=adr;	msg[1].flags=I2C_M_RD;	msg[1].len=rxlen;	msg[1].buf=rx;
+		rdwr.msgs=msg;
+		rdwr.nmsgs=2;
+		if( rxlen==0 || ioctl(b->dev_fd,I2C_RDWR,&rdwr)!=2 ){
+			_bus_error(b,"i2c_write_read / i2c-dev Error");
+			return 0;
+		}
+		return rxlen;
+	}
+	if(b->backend==I2CD_IO) return _i2cd_xfer(b,I2CD_WRITE_READ,adr,tx,txlen,rx,rxlen);
+	if(b->backend==I2C_REPLAY_IO) return _replay_xfer(b,I2CD_WRITE_READ,adr,tx,txlen,rx,rxlen);
+	if(b->backend==I2C_SIM_IO){
+		if( rxlen==0 || !_i2c_sim_xfer(b,adr,tx,txlen,rx,rxlen) ){
+			_bus_error(b,"i2c_write_read / sim Error");
+			return 0;
+		}
+		return rxlen;
+	}
+	_ramda_select(b,adr);
+	if( !i2c_start_ex(b) ) return 0;
+	wadr = adr<<1;							// 7ビット->8ビット
+	wadr &= 0xFE;							// RW=0 送信モード
+	if( i2c_tx_ex(b,wadr)==0 && b->error_check ){
+		b->nack=STATS_NACK_ADR;
+		_bus_error(b,"i2c_write_read / no ACK (Address)");
+		_i2c_stop(b);
+		return 0;
+	}
+	for(ret=0;ret<txlen;ret++){
+		i2c_SDA_ex(b,0);					// (SDA)	L Out
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
+		if( i2c_tx_ex(b,tx[ret]) == 0 && b->error_check){
+			b->nack=STATS_NACK_DATA;
+			_bus_error(b,"i2c_write_read / no ACK (Writing)");
+			_i2c_stop(b);
+			return 0;
+		}
+	}
+	/* Repeated START */
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	i2c_SDA_ex(b,1);						// (SDA)	H Imp
+	i2c_SCL_ex(b,1);						// (SCL)	H Imp
+	i2c_SDA_ex(b,0);						// (SDA)	L Out
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	ret=_i2c_rx(b,adr,rx,rxlen);
+	_i2c_stop(b);
+	return ret;
+}
+
+byte i2c_write_read_ex(i2c_bus *b, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen){
+	byte ret, txc[256];
+	_stats_begin(b,adr);
+	if(b->rec) memcpy(txc,tx,txlen);		// tx と rx に同じバッファを渡す呼出しがある
+	ret=_i2c_write_read(b,adr,tx,txlen,rx,rxlen);
+	if(b->rec) _rec_add(b,txlen ? I2CD_WRITE_READ : I2CD_READ,adr,txc,txlen,rx,rxlen,ret);	// txlen=0 は受信のみ(再生も i2c_read)
+	return _stats_end(b,ret,ret ? (uint32_t)txlen+ret : 0);
+}
+
+static byte _i2c_write(i2c_bus *b, byte adr, byte *tx, byte len){
+/*
+入力：byte adr = I2Cアドレス(7ビット)
+入力：byte *tx = 送信データ用ポインタ
+入力：byte len = 送信データ長（0のときはアドレスのみを送信する）
+戻り値：０の時はエラー(または送信データ長0)
+*/
+	byte ret=0;
+	if(b->backend==I2C_DEV_IO){
+		if( !_i2c_dev_xfer(b,adr,0,tx,len) ){
+			if(len>0) _bus_error(b,"i2c_write / i2c-dev Error");	// len=0の時はエラーにしないAM2320用
+			return 0;
+		}
+		return len;
+	}
+	if(b->backend==I2CD_IO) return _i2cd_xfer(b,I2CD_WRITE,adr,tx,len,NULL,0);
+	if(b->backend==I2C_REPLAY_IO) return _replay_xfer(b,I2CD_WRITE,adr,tx,len,NULL,0);
+	if(b->backend==I2C_SIM_IO){
+		if( !_i2c_sim_xfer(b,adr,tx,len,NULL,0) ){
+			if(len>0) _bus_error(b,"i2c_write / sim Error");	// len=0の時はエラーにしないAM2320用
+			return 0;
+		}
+		return len;
+	}
+	_ramda_select(b,adr);
+	if( !i2c_start_ex(b) ) return 0;
+	adr <<= 1;								// 7ビット->8ビット
+	adr &= 0xFE;							// RW=0 送信モード
+	if( i2c_tx_ex(b,adr)>0 ){
+		/* データ送信 */
+		for(ret=0;ret<len;ret++){
+			i2c_SDA_ex(b,0);				// (SDA)	L Out
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+			if( i2c_tx_ex(b,tx[ret]) == 0 && b->error_check){
+				b->nack=STATS_NACK_DATA;
+				_bus_error(b,"i2c_write / no ACK (Writing)");
+				return 0;
+			}
+		}
+	}else if( len>0 && b->error_check){		// len=0の時はエラーにしないAM2320用
+		b->nack=STATS_NACK_ADR;
+		_bus_error(b,"i2c_write / no ACK (Address)");
+		return 0;
+	}
+	/* STOP */
+	i2c_SDA_ex(b,0);						// (SDA)	L Out
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	_delayNanoseconds(b,b->ramda);
+	if(len==0)_delayNanoseconds(b,800000);	// AM2320用
+	i2c_SCL_ex(b,1);						// (SCL)	H Imp
+	_delayNanoseconds(b,b->ramda);
+	i2c_SDA_ex(b,1);						// (SDA)	H Imp
+	return ret;
+}
+
+byte i2c_write_ex(i2c_bus *b, byte adr, byte *tx, byte len){
+	byte ret;
+	_stats_begin(b,adr);
+	ret=_i2c_write(b,adr,tx,len);
+	if(b->rec) _rec_add(b,I2CD_WRITE,adr,tx,len,NULL,0,ret);
+	return _stats_end(b,ret,ret);
+}
+
+/* 一括実行(バッチ)
+	命令と送信データを i2c_batch に複写して並べ、i2c_batch_run でまとめて実行する。
+	ビットバングは命令を続けて実行し、i2c-dev は待ち時間の命令までを1回の
+	I2C_RDWR (命令間は Repeated START)、i2cd は全命令を1回の要求で送る。
+*/
+void i2c_batch_clear(i2c_batch *q){
+	q->n=0;
+	q->len=0;
+	q->overflow=0;
+}
+
+static i2c_batch_op *_batch_add(i2c_batch *q, byte op, byte adr, const byte *tx, byte txlen){
+// 戻り値：追加した命令、NULLの時は上限超過
+	i2c_batch_op *o;
+	if(q->n>=I2C_BATCH_OPS || q->len+txlen>I2C_BATCH_BUF){
+		q->overflow=1;
+		return NULL;
+	}
+	o=&q->ops[q->n++];
+	memset(o,0,sizeof(i2c_batch_op));
+	o->op=op;
+	o->adr=adr;
+	o->txlen=txlen;
+	o->tx=(uint16_t)q->len;
+	if(txlen) memcpy(&q->buf[q->len],tx,txlen);
+	q->len+=txlen;
+	return o;
+}
+
+byte i2c_batch_write(i2c_batch *q, byte adr, const byte *tx, byte len){
+// 戻り値：０の時はエラー(上限超過、送信長0)
+	if(len==0) return 0;
+	return _batch_add(q,I2C_BATCH_WRITE,adr,tx,len)!=NULL;
+}
+
+byte i2c_batch_read(i2c_batch *q, byte adr, byte *rx, byte len){
+	i2c_batch_op *o;
+	if(len==0) return 0;
+	o=_batch_add(q,I2C_BATCH_READ,adr,NULL,0);
+	if(o==NULL) return 0;
+	o->rx=rx;
+	o->rxlen=len;
+	return 1;
+}
+
+byte i2c_batch_write_read(i2c_batch *q, byte adr, const byte *tx, byte txlen, byte *rx, byte rxlen){
+	i2c_batch_op *o;
+	if(txlen==0 || rxlen==0) return 0;
+	o=_batch_add(q,I2C_BATCH_WRITE_READ,adr,tx,txlen);
+	if(o==NULL) return 0;
+	o->rx=rx;
+	o->rxlen=rxlen;
+	return 1;
+}
+
+byte i2c_batch_delay(i2c_batch *q, uint16_t ms){
+// 直前の命令の完了から ms 経過するまで待つ(完了時刻からの絶対時刻で待つ)
+	i2c_batch_op *o=_batch_add(q,I2C_BATCH_DELAY,0,NULL,0);
+	if(o==NULL) return 0;
+	o->ms=ms;
+	return 1;
+}
+
+static int _batch_ok(i2c_batch *q){
+// 戻り値：先頭から成功した命令数
+	int i;
+	for(i=0;i<q->n && q->ops[i].status;i++) ;
+	return i;
+}
+
+static void _i2c_dev_batch(i2c_bus *b, i2c_batch *q){
+	struct i2c_msg msg[I2C_RDWR_IOCTL_MAX_MSGS];
+	struct i2c_rdwr_ioctl_data rdwr;
+	i2c_batch_op *o;
+	int i=0,j,first,n;
+	while(i<q->n){
+		o=&q->ops[i];
+		if(o->op==I2C_BATCH_DELAY){
+			_bench_sleep(_now_ns()+o->ms*1000000ull,I2C_BENCH_SLEEP);
+			o->status=1;
+			i++;
+			continue;
+		}
+		for(first=i,n=0; i<q->n && q->ops[i].op!=I2C_BATCH_DELAY && n+2<=I2C_RDWR_IOCTL_MAX_MSGS; i++){
+			o=&q->ops[i];
+			if(o->op!=I2C_BATCH_READ){
+				msg[n].addr=o->adr;	msg[n].flags=0;			msg[n].len=o->txlen;	msg[n].buf=&q->buf[o->tx];
+				n++;
+			}
+			if(o->op!=I2C_BATCH_WRITE){
+				msg[n].addr=o->adr;	msg[n].flags=I2C_M_RD;	msg[n].len=o->rxlen;	msg[n].buf=o->rx;
+				n++;
+			}
+		}
+		rdwr.msgs=msg;
+		rdwr.nmsgs=n;
+		if( ioctl(b->dev_fd,I2C_RDWR,&rdwr)!=n ){	// どの命令で失敗したかは分からない
+			_bus_error(b,"i2c_batch_run / i2c-dev Error");
+			return;
+		}
+		for(j=first;j<i;j++){
+			o=&q->ops[j];
+			o->status = o->rxlen ? o->rxlen : o->txlen;
+		}
+	}
+}
+
+static void _i2cd_batch(i2c_bus *b, i2c_batch *q){
+	byte req[I2CD_FRAME], res[I2CD_FRAME];
+	i2c_batch_op *o;
+	int i,pos=1,out=0;
+	ssize_t len;
+	for(i=0;i<q->n;i++) out+=1+q->ops[i].rxlen;
+	if(out>I2CD_FRAME){
+		_bus_error(b,"i2c_batch_run / too long for i2cd");
+		return;
+	}
+	req[0]=(byte)q->n;
+	for(i=0;i<q->n;i++){
+		o=&q->ops[i];
+		req[pos]=o->op;
+		req[pos+1]=o->adr;
+		req[pos+2]=o->txlen;
+		req[pos+3]=o->rxlen;
+		pos+=I2CD_OP_HEAD;
+		if(o->op==I2C_BATCH_DELAY){			// 待ち時間は送信データ2バイト
+			req[pos-2]=2;
+			req[pos]=(byte)(o->ms&0xFF);
+			req[pos+1]=(byte)(o->ms>>8);
+			pos+=2;
+		}else if(o->txlen){
+			memcpy(&req[pos],&q->buf[o->tx],o->txlen);
+			pos+=o->txlen;
+		}
+	}
+	if( send(b->i2cd_fd,req,pos,0)<0 ||
+		(len=recv(b->i2cd_fd,res,sizeof(res),0)) != out ){
+		_bus_error(b,"i2cd / connection Error");
+		return;
+	}
+	for(pos=0,i=0;i<q->n;i++){
+		o=&q->ops[i];
+		o->status=res[pos];
+		if(o->rxlen) memcpy(o->rx,&res[pos+1],o->rxlen);
+		pos+=1+o->rxlen;
+	}
+}
+
+static void _stats_batch(i2c_bus *b, i2c_batch *q, uint64_t t){
+// 一括で実行した命令を統計に記録する(所要時間は命令数で等分、エラーの命令まで)
+	i2c_batch_op *o;
+	int i,n=0;
+	if(!b->stats || b->stats_depth) return;
+	for(i=0;i<q->n;i++) if(q->ops[i].op!=I2C_BATCH_DELAY) n++;
+	b->nack=0;
+	for(i=0;i<q->n;i++){
+		o=&q->ops[i];
+		if(o->op!=I2C_BATCH_DELAY) _stats_record(b,o->adr,o->status,o->status ? (uint32_t)o->txlen+o->rxlen : 0,t/n);
+		if(!o->status) break;
+	}
+}
+
+static void _rec_batch(i2c_bus *b, i2c_batch *q, uint64_t t0, uint64_t t){
+// 一括で実行した命令を通信の記録に書き出す(命令の種類は I2CD_* と同じ値)
+	i2c_batch_op *o;
+	int i,n=0;
+	if(b->stats_depth) return;
+	for(i=0;i<q->n;i++) if(q->ops[i].op!=I2C_BATCH_DELAY) n++;
+	b->nack=0;
+	for(i=0;i<q->n;i++){
+		o=&q->ops[i];
+		if(o->op!=I2C_BATCH_DELAY) _rec_write(b,o->op,o->adr,&q->buf[o->tx],o->txlen,o->rx,o->rxlen,o->status,t0,t/n);
+		if(!o->status || !b->rec) break;	// 書き出せないときは記録が終わる
+	}
+}
+
+int i2c_batch_run_ex(i2c_bus *b, i2c_batch *q){
+/*
+入力：i2c_batch *q = i2c_batch_write 等で命令を並べたバッチ
+戻り値：先頭から成功した命令数 (q->n の時は全て成功)、各命令の結果は q->ops[].status
+*/
+	i2c_batch_op *o;
+	uint64_t t,t0,sleep;
+	int i;
+	for(i=0;i<q->n;i++) q->ops[i].status=0;
+	if(q->overflow){
+		_bus_error(b,"i2c_batch_run / too many operations");
+		return 0;
+	}
+	if(b->backend==I2C_DEV_IO || b->backend==I2CD_IO){
+		t0=_now_ns();
+		sleep=i2c_bench_total(I2C_BENCH_SLEEP);
+		if(b->trace) _trace_add(b,TRACE_BEGIN,0,0);
+		if(b->backend==I2C_DEV_IO) _i2c_dev_batch(b,q);
+		else _i2cd_batch(b,q);
+		if(b->trace) _trace_add(b,TRACE_END,_batch_ok(q)==q->n ? 0 : 3,0);
+		t=_now_ns()-t0;
+		_stats_batch(b,q,t);
+		if(b->rec) _rec_batch(b,q,t0,t);
+		if(!b->stats_depth) i2c_bench_add(I2C_BENCH_BUS,t-(i2c_bench_total(I2C_BENCH_SLEEP)-sleep));	// 待ち時間の命令は除く
+	}else for(t=_now_ns(),i=0;i<q->n;i++,t=_now_ns()){
+		o=&q->ops[i];
+		switch(o->op){
+			case I2C_BATCH_WRITE:
+				o->status=i2c_write_ex(b,o->adr,&q->buf[o->tx],o->txlen);
+				break;
+			case I2C_BATCH_READ:
+				o->status=i2c_read_ex(b,o->adr,o->rx,o->rxlen);
+				break;
+			case I2C_BATCH_WRITE_READ:
+				o->status=i2c_write_read_ex(b,o->adr,&q->buf[o->tx],o->txlen,o->rx,o->rxlen);
+				break;
+			case I2C_BATCH_DELAY:
+				_bench_sleep(t+o->ms*1000000ull,I2C_BENCH_SLEEP);
+				o->status=1;
+				break;
+		}
+		if(!o->status) break;				// エラーの命令で止める
+	}
+	return _batch_ok(q);
+}
+
+/* I2C マルチプレクサ TCA9548A
+	同じアドレスのデバイスを mux のチャネルごとに接続し、(mux, チャネル, アドレス)で
+	指定する。選択中の mux とチャネルを覚えておき、変わるときだけ選択を書き込む。
+	別の mux に切り換えるときは前の mux の選択を解除する(同時に2つのチャネルを開かない)。
+	i2cd 方式では他のクライアントが選択を変えるため覚えておかず、選択と通信を
+	1回の要求(バッチ)で送る。
+*/
+byte i2c_mux_select_ex(i2c_bus *b, byte mux, byte ch){
+/*
+入力：byte mux = TCA9548A のアドレス(7ビット)、0:選択を解除(mux を通さないデバイス用)
+入力：byte ch = チャネル 0～7
+戻り値：０の時はエラー
+*/
+	byte sel=0;
+	if(ch>7) return 0;
+	if(b->backend==I2CD_IO){
+		if(mux==0) return 1;
+		sel=1<<ch;
+		b->mux_sel++;
+		return i2c_write_ex(b,mux,&sel,1);
+	}
+	if(b->mux_adr==mux && (mux==0 || b->mux_ch==ch)){
+		b->mux_skip++;
+		return 1;
+	}
+	if(b->mux_adr && b->mux_adr!=mux){		// 前の mux の選択を解除
+		b->mux_sel++;
+		if( !i2c_write_ex(b,b->mux_adr,&sel,1) ) return 0;
+		b->mux_adr=0;
+	}
+	if(mux==0) return 1;
+	sel=1<<ch;
+	b->mux_sel++;
+	if( !i2c_write_ex(b,mux,&sel,1) ){
+		b->mux_adr=0;						// 次回は必ず選択し直す
+		return 0;
+	}
+	b->mux_adr=mux;
+	b->mux_ch=ch;
+	return 1;
+}
+
+byte i2c_mux_write_read_ex(i2c_bus *b, byte mux, byte ch, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen){
+/*
+mux のチャネルを選択して i2c_write (rxlen=0)、i2c_read (txlen=0)、i2c_write_read を行う
+戻り値：各関数の戻り値、０の時はエラー
+*/
+	i2c_batch q;
+	byte sel=1<<(ch&7), ok;
+	if(b->backend==I2CD_IO && mux){
+		i2c_batch_clear(&q);
+		ok=i2c_batch_write(&q,mux,&sel,1);
+		if(rxlen==0) ok&=i2c_batch_write(&q,adr,tx,txlen);
+		else if(txlen==0) ok&=i2c_batch_read(&q,adr,rx,rxlen);
+		else ok&=i2c_batch_write_read(&q,adr,tx,txlen,rx,rxlen);
+		if(!ok){								// 送信長0の書込み等はバッチにできない
+			i2c_error("i2c_mux_write_read / batch Error");
+			return 0;
+		}
+		b->mux_sel++;
+		return i2c_batch_run_ex(b,&q)==2 ? q.ops[1].status : 0;
+	}
+	if( !i2c_mux_select_ex(b,mux,ch) ) return 0;
+	if(rxlen==0) return i2c_write_ex(b,adr,tx,txlen);
+	return i2c_write_read_ex(b,adr,tx,txlen,rx,rxlen);
+}
+
+static void _mux_run_group(i2c_bus *b, i2c_mux_op *ops, int n, byte mux, byte ch){
+	int i;
+	for(i=0;i<n;i++){
+		if(ops[i].mux!=mux || (mux && ops[i].ch!=ch)) continue;
+		ops[i].status=i2c_mux_write_read_ex(b,mux,ch,ops[i].adr,ops[i].tx,ops[i].txlen,ops[i].rx,ops[i].rxlen);
+	}
+}
+
+int i2c_mux_run_ex(i2c_bus *b, i2c_mux_op *ops, int n){
+/*
+並べた通信を mux のチャネルごとにまとめて実行する(選択の書込みをチャネル数分に減らす)
+選択中のチャネルの通信を最初に、以降は各チャネルの最初の通信の順。
+エラーの通信があっても残りは実行する(結果は ops[].status)。
+戻り値：成功した通信の数
+*/
+	int i,j,ok=0;
+	byte mux=b->mux_adr, ch=b->mux_ch;
+	if(b->backend==I2CD_IO) mux=0;			// 選択中のチャネルは不明
+	_mux_run_group(b,ops,n,mux,ch);
+	for(i=0;i<n;i++){
+		if(ops[i].mux==mux && (mux==0 || ops[i].ch==ch)) continue;	// 実行済み
+		for(j=0;j<i;j++){
+			if(ops[j].mux==ops[i].mux && (ops[i].mux==0 || ops[j].ch==ops[i].ch)) break;
+		}
+		if(j<i) continue;					// 同じチャネルは実行済み
+		_mux_run_group(b,ops,n,ops[i].mux,ops[i].ch);
+	}
+	for(i=0;i<n;i++) ok += ops[i].status!=0;
+	return ok;
+}
+
+uint32_t i2c_mux_stats_ex(i2c_bus *b, uint32_t *skipped){
+// TCA9548A の選択を書き込んだ回数(戻り値)と、選択中と同じため省略した回数 (i2c_init でリセット)
+	if(skipped) *skipped=b->mux_skip;
+	return b->mux_sel;
+}
+
+/* 複数の SDA (レーン)での同時通信 (GPIO_MMAP_IO のみ)
+	同じアドレスの同型デバイスを SDA ごとに接続し、SCL を共有して同時に
+	読み出す。各ビットは全レーン分を1回のレジスタ操作で出力し、GPLEV0 の
+	1回の読込みで全レーン分を取得する(ビットスライス)。
+	NACK のレーンはその時点で SDA を解放し、以降の通信から外す。
+*/
+static byte _lanes_read(i2c_bus *b){
+// 戻り値：各レーンの SDA の値 (bit0:レーン0)
+	uint32_t lev=b->map[GPLEV0];
+	byte ret=0;
+	int i;
+	for(i=0;i<b->lanes;i++) ret |= ((lev>>b->lane_sda[i])&1)<<i;
+	if(b->trace) _trace_add(b,TRACE_LANES_IN,ret,0);
+	return ret;
+}
+
+static byte _lanes_start(i2c_bus *b, byte *alive){
+// 戻り値：０の時はエラー(SCL のロック)
+	byte all=_lanes_all(b);
+	int i;
+	_lanes_sda(b,all);						// (SDA)	H Imp
+	i2c_SCL_ex(b,1);						// (SCL)	H Imp
+	for(i=0;i<9 && _lanes_read(b)!=all;i++){	// SDA が L のレーンがあるときは SCL をクロック
+		i2c_SCL_ex(b,0);
+		i2c_SCL_ex(b,1);
+	}
+	if( _gpio_read(b,LINE_SCL)!=1 ) return 0;
+	if( b->error_check ) *alive &= _lanes_read(b);	// 解放されないレーンは外す
+	_delayNanoseconds(b,b->ramda*8);
+	_lanes_sda(b,all & ~*alive);			// (SDA)	L Out
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	return 1;
+}
+
+static byte _lanes_tx(i2c_bus *b, const byte in, byte *alive){
+// 戻り値：０の時はエラー(ストレッチ待ちのタイムアウト)、ACK は *alive に反映
+	byte all=_lanes_all(b);
+	byte ack=0;
 	int i;
-    #ifdef DEBUG
-    	char s[32];
-		sprintf(s,"tx data = [%02X]",in);
-		i2c_log(s);
-    #endif
 	for(i=0;i<8;i++){
-		if( (in>>(7-i))&0x01 ){
-				i2c_SDA(1);					// (SDA)	H Imp
-		}else	i2c_SDA(0);					// (SDA)	L Out
-		/*Clock*/
-		i2c_SCL(1);							// (SCL)	H Imp
-		i2c_SCL(0);							// (SCL)	L Out
+		if( (in>>(7-i))&0x01 ) _lanes_sda(b,all);	// (SDA)	H Imp
+		else _lanes_sda(b,all & ~*alive);	// (SDA)	L Out (外したレーンは解放)
+		if( !i2c_SCL_ex(b,1) ) return 0;	// (SCL)	H Imp
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
 	}
 	/* ACK処理 */
-	_delayMicroseconds(I2C_RAMDA);
-	i2c_SDA(1);								// (SDA)	H Imp  2016/6/26 先にSDAを終わらせる
-	i2c_SCL(1);								// (SCL)	H Imp
-	for(i=3;i>0;i--){						// さらにクロックを上げた瞬間には確定しているハズ
-		if( digitalRead(PORT_SDA) == 0 ) break;	// 速やかに確認
-		_delayMicroseconds(I2C_RAMDA/2);
+	_delayNanoseconds(b,b->ramda);
+	_lanes_sda(b,all);						// (SDA)	H Imp
+	if( !i2c_SCL_ex(b,1) ) return 0;		// (SCL)	H Imp
+	for(i=3;i>0;i--){
+		ack |= ~_lanes_read(b) & *alive;
+		if( ack==*alive ) break;
+		_delayNanoseconds(b,b->ramda/2);
 	}
-	if(i==0 && ERROR_CHECK ){
-		i2c_SCL(0);							// (SCL)	L Out
-		i2c_log("no ACK");
+	if( b->error_check ) *alive = ack;
+	return 1;
+}
+
+static void _lanes_stop(i2c_bus *b){
+	i2c_SCL_ex(b,0);						// (SCL)	L Out
+	_lanes_sda(b,0);						// (SDA)	L Out
+	_delayNanoseconds(b,b->ramda);
+	i2c_SCL_ex(b,1);						// (SCL)	H Imp
+	_delayNanoseconds(b,b->ramda);
+	_lanes_sda(b,_lanes_all(b));			// (SDA)	H Imp
+}
+
+byte i2c_write_read_lanes(i2c_bus *b, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen){
+/*
+全レーンの同じアドレスに tx を送信し、Repeated START で rxlen バイトを受信する
+入力：byte adr = I2Cアドレス(7ビット)
+入力：byte *tx = 送信データ用ポインタ(全レーン共通、レジスタ番号など)
+入力：byte txlen = 送信データ長
+出力：byte *rx = 受信データ用ポインタ(レーン数×rxlen バイト、レーンiは rx[i*rxlen]から)
+入力：byte rxlen = 受信長
+戻り値：byte 最後まで ACK を返したレーン (bit0:レーン0)、０の時は全レーンがエラー
+*/
+	byte all,alive,ret,i,lane;
+	byte lev;
+
+	if(b->backend!=GPIO_MMAP_IO){
+		_bus_error(b,"i2c_write_read_lanes / mmap backend only");
 		return 0;
 	}
-    #ifdef DEBUG
-    //	fprintf(stderr,"i2c_tx / GPIO_RETRY (%d/%d)\n",GPIO_RETRY-i,GPIO_RETRY);
-    #endif
-	return (byte)i;
+	all=alive=_lanes_all(b);
+	memset(rx,0,(size_t)b->lanes*rxlen);
+	_ramda_select(b,adr);
+	if(b->trace) _trace_add(b,TRACE_BEGIN,adr&0x7F,0);
+	if( !_lanes_start(b,&alive) ){
+		_bus_error(b,"i2c_write_read_lanes / Locked Lines");
+		if(b->trace) _trace_add(b,TRACE_END,3,0);
+		return 0;
+	}
+	if( txlen ){
+		if( !_lanes_tx(b,(byte)(adr<<1),&alive) ) goto stop;	// RW=0 送信モード
+		for(i=0;i<txlen && alive;i++){
+			_lanes_sda(b,all & ~alive);		// (SDA)	L Out
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+			if( !_lanes_tx(b,tx[i],&alive) ) goto stop;
+		}
+		/* Repeated START */
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
+		_lanes_sda(b,all);					// (SDA)	H Imp
+		i2c_SCL_ex(b,1);					// (SCL)	H Imp
+		_lanes_sda(b,all & ~alive);			// (SDA)	L Out
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
+	}
+	if( !alive || !_lanes_tx(b,(byte)((adr<<1)|0x01),&alive) ) goto stop;	// RW=1 受信モード
+	/* 受信データ */
+	for(ret=0;ret<rxlen && alive;ret++){
+		i2c_SCL_ex(b,0);					// (SCL)	L Out
+		_lanes_sda(b,all);					// (SDA)	H Imp
+		for(i=0;i<8;i++){
+			if( !i2c_SCL_ex(b,1) ) goto stop;	// (SCL)	H Imp
+			lev=_lanes_read(b) & alive;		// 全レーン分を1回で読む
+			for(lane=0;lane<b->lanes;lane++) rx[lane*rxlen+ret] |= ((lev>>lane)&1)<<(7-i);
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+		}
+		if(ret<rxlen-1) _lanes_sda(b,all & ~alive);	// ACKを応答する
+		else _lanes_sda(b,all);				// NACKを応答する
+		i2c_SCL_ex(b,1);					// (SCL)	H Imp
+		_delayNanoseconds(b,b->ramda);
+	}
+	_lanes_stop(b);
+	if(b->trace) _trace_add(b,TRACE_END,alive ? 0 : STATS_NACK_DATA,0);
+	return alive;
+stop:
+	_lanes_stop(b);
+	_bus_error(b,"i2c_write_read_lanes / no ACK");
+	if(b->trace) _trace_add(b,TRACE_END,STATS_NACK_ADR,0);
+	return 0;
 }
 
-byte i2c_init(void){
-// 戻り値：０の時はエラー
-	int i;
+byte i2c_scan_ex(i2c_bus *b, byte *found){
+/*
+アドレス I2C_SCAN_FIRST～I2C_SCAN_LAST の応答を続けて確認する
+アドレスごとの STOP とバス開放の待ち時間を省き、Repeated START でつなぐ
+(i2c-dev, i2cd は i2c_check と同じ。複数レーンのバスは全レーンを同時に確認)
+出力：byte *found = 128バイト、found[adr] に ACK を返したレーン (bit0:レーン0)
+戻り値：応答したアドレスの数
+*/
+	byte all,start,alive;
+	int check=b->error_check;
+	int adr,n=0;
 
-	_micros_0();
-	i2c_log("I2C_Init");
-    for(i=0;i<2;i++){
-		fgpio = fopen("/sys/class/gpio/export","w");
-	    if(fgpio==NULL ){
-	        i2c_error("I2C_Init / IO Settiong Error\n");
-	        printf("9\n");
-	        return 0;
-	    }
-	    fprintf(fgpio,"%d\n",i + PORT_SDANUM);
-	    fclose(fgpio);
+	memset(found,0,128);
+	if(b->backend>=I2C_DEV_IO){
+		for(adr=I2C_SCAN_FIRST;adr<=I2C_SCAN_LAST;adr++){
+			found[adr]=i2c_check_ex(b,(byte)adr) ? 1 : 0;
+			n += found[adr];
+		}
+		return n;
 	}
-	for(i=GPIO_RETRY;i>0;i--){						// リトライ50回まで
-		i2c_SDA(1);							// (SDA)	H Imp
-		i2c_SCL(1);							// (SCL)	H Imp
-		if( digitalRead(PORT_SCL)==1 &&
-			digitalRead(PORT_SDA)==1  ) break;
-		delay(1);
+	b->ramda=b->ramda_def;
+	if(b->lanes>1){
+		if(b->backend!=GPIO_MMAP_IO){
+			_bus_error(b,"i2c_scan / mmap backend only");
+			return 0;
+		}
+		all=start=_lanes_all(b);
+		b->error_check=1;					// ACK をレーンごとに確認
+		if( !_lanes_start(b,&start) ){
+			_bus_error(b,"i2c_scan / Locked Lines");
+			b->error_check=check;
+			return 0;
+		}
+		for(adr=I2C_SCAN_FIRST;adr<=I2C_SCAN_LAST;adr++){
+			alive=start;
+			if(b->trace) _trace_add(b,TRACE_BEGIN,(byte)adr,0);
+			if( !_lanes_tx(b,(byte)(adr<<1),&alive) ) alive=0;	// RW=0 送信モード
+			if(b->trace) _trace_add(b,TRACE_END,alive ? 0 : STATS_NACK_ADR,0);
+			found[adr]=alive;
+			n += alive!=0;
+			/* Repeated START */
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+			_lanes_sda(b,all);				// (SDA)	H Imp
+			i2c_SCL_ex(b,1);				// (SCL)	H Imp
+			_lanes_sda(b,all & ~start);		// (SDA)	L Out
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+		}
+		_lanes_stop(b);
+	}else{
+		if( !i2c_start_ex(b) ){
+			_bus_error(b,"i2c_scan / aborted i2c_start");
+			return 0;
+		}
+		b->error_check=0;					// NACK でも SCL を H のまま戻す
+		for(adr=I2C_SCAN_FIRST;adr<=I2C_SCAN_LAST;adr++){
+			if(b->trace) _trace_add(b,TRACE_BEGIN,(byte)adr,0);
+			found[adr]=i2c_tx_ex(b,(byte)(adr<<1)) ? 1 : 0;	// RW=0 送信モード
+			if(b->trace) _trace_add(b,TRACE_END,found[adr] ? 0 : STATS_NACK_ADR,0);
+			n += found[adr];
+			/* Repeated START */
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+			i2c_SDA_ex(b,1);				// (SDA)	H Imp
+			i2c_SCL_ex(b,1);				// (SCL)	H Imp
+			i2c_SDA_ex(b,0);				// (SDA)	L Out
+			i2c_SCL_ex(b,0);				// (SCL)	L Out
+		}
+		_i2c_stop(b);
 	}
-	if(i==0) i2c_error("I2C_Init / Locked Lines");
-    #ifdef DEBUG
-    //	fprintf(stderr,"i2c_init / GPIO_RETRY (%d/%d)\n",GPIO_RETRY-i,GPIO_RETRY);
-    #endif
-	_delayMicroseconds(I2C_RAMDA*8);
-	return (byte)i;
+	b->error_check=check;
+	return n;
 }
 
-byte i2c_close(void){
-// 戻り値：０の時はエラー
-	byte i;
-	i2c_log("i2c_close");
-    for(i=0;i<2;i++){
-		fgpio = fopen("/sys/class/gpio/unexport","w");
-	    if(fgpio==NULL ){
-	        fprintf(stderr,"IO Error\n");
-	        printf("9\n");
-	        return 0;
-	    }
-	    fprintf(fgpio,"%d\n",i + PORT_SDANUM);
-	    fclose(fgpio);
+static FILE *_save_open(const char *path, char *tmp, int len){
+// 保存用の一時ファイル(パス.PID)を作成する 戻り値：NULLの時はエラー
+	FILE *fp;
+	int fd;
+	snprintf(tmp,len,"%s.%d",path,(int)getpid());	// 同時に保存しても衝突しない
+	fd=open(tmp,O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC,0666);	// /tmp のリンクはたどらない
+	if(fd<0) return NULL;
+	fp=fdopen(fd,"w");
+	if(fp==NULL){
+		close(fd);
+		remove(tmp);
 	}
-	return 1;
+	return fp;
 }
 
-byte i2c_start(void){
-// 戻り値：０の時はエラー
-//	if(!i2c_init())return(0);				// SDA,SCL  H Out
+byte i2c_timing_save_ex(i2c_bus *b){
+// アドレス別シンボル長を保存する 戻り値：０の時はエラー
+	FILE *fp;
+	char tmp[S_PATH+16];
+	char buf[S_PATH];
+	const char *path=_timing_path(b,buf);
 	int i;
-
-	for(i=5000;i>0;i--){					// リトライ 5000ms
-		i2c_SDA(1);							// (SDA)	H Imp
-		i2c_SCL(1);							// (SCL)	H Imp
-		if( digitalRead(PORT_SCL)==1 &&
-			digitalRead(PORT_SDA)==1  ) break;
-		delay(1);
+	fp=_save_open(path,tmp,sizeof(tmp));
+	if(fp==NULL){
+		_bus_error(b,"i2c_timing_save / open Error");
+		return 0;
 	}
-	i2c_log("i2c_start");
-	if(i==0 && ERROR_CHECK) i2c_error("i2c_start / Locked Lines");
-	_delayMicroseconds(I2C_RAMDA*8);
-	i2c_SDA(0);								// (SDA)	L Out
-	_delayMicroseconds(I2C_RAMDA);
-	i2c_SCL(0);								// (SCL)	L Out
-	return (byte)i;
-}
-
-byte i2c_check(byte adr){
-/*
-入力：byte adr = I2Cアドレス(7ビット)
-戻り値：０の時はエラー
-*/
-	byte ret;
-	if( !i2c_start() ) {
-		i2c_error("i2c_check / aborted i2c_start");
+	for(i=0;i<128;i++) if(b->ramda_adr[i]) fprintf(fp,"%02X %u\n",i,b->ramda_adr[i]);
+	fclose(fp);
+	if(rename(tmp,path)){
+		remove(tmp);
+		_bus_error(b,"i2c_timing_save / rename Error");
 		return 0;
 	}
-	adr <<= 1;								// 7ビット->8ビット
-	adr &= 0xFE;							// RW=0 送信モード
-	ret=i2c_tx(adr);
-
-	/* STOP */
-	i2c_SDA(0);								// (SDA)	L Out
-	i2c_SCL(0);								// (SCL)	L Out
-	_delayMicroseconds(I2C_RAMDA);
-	i2c_SCL(1);								// (SCL)	H Imp
-	_delayMicroseconds(I2C_RAMDA);
-	i2c_SDA(1);								// (SDA)	H Imp
-	return ret;
+	return 1;
 }
 
+/* アドレス検索結果(インベントリ)
+	raspi_i2cdetect が応答したアドレスを1行ずつ保存する(アドレス レーン 付加情報)。
+	各 raspi_* はこれを読めば、起動時に通信して確認しなくてよい。
+	i2c_init 前にも読めるよう、ファイルは SDA の GPIO 番号ごと(方式によらない)。
+*/
+static const char *_inventory_path(i2c_bus *b, char *path){
+	const char *env=getenv("SOFT_I2C_INVENTORY");	// 既定のバスのみ
+	if(b==&_bus0 && env && env[0]) return env;
+	snprintf(path,S_PATH,"%s/soft_i2c_gpio%d.inventory",INVENTORY_DIR,b->sda);
+	return path;
+}
 
-byte i2c_read(byte adr, byte *rx, byte len){
+byte i2c_inventory_save_ex(i2c_bus *b, const byte *found, const char * const *info){
 /*
-入力：byte adr = I2Cアドレス(7ビット)
-出力：byte *rx = 受信データ用ポインタ
-入力：byte len = 受信長
-戻り値：byte 受信結果長、０の時はエラー
+入力：byte *found = i2c_scan の結果(128バイト)
+入力：char **info = アドレスごとの付加情報(チップ名など、空白なし)、NULL 可
+戻り値：０の時はエラー
 */
-	byte ret,i;
-	
-	if( !i2c_start() && ERROR_CHECK) return 0;
-	adr <<= 1;								// 7ビット->8ビット
-	adr |= 0x01;							// RW=1 受信モード
-	if( i2c_tx(adr)==0 && ERROR_CHECK ){	// アドレス設定
-		i2c_error("I2C_RX / no ACK (Address)");
-		return 0;		
+	FILE *fp;
+	char tmp[S_PATH+16];
+	char buf[S_PATH];
+	const char *path=_inventory_path(b,buf);
+	int i;
+	fp=_save_open(path,tmp,sizeof(tmp));
+	if(fp==NULL){
+		_bus_error(b,"i2c_inventory_save / open Error");
+		return 0;
 	}
-	
-	/* スレーブ待機状態待ち */
-	for(i=GPIO_RETRY;i>0;i--){
-		_delayMicroseconds(I2C_RAMDA);
-		if( digitalRead(PORT_SDA)==0  ) break;
+	for(i=0;i<128;i++) if(found[i]){
+		fprintf(fp,"%02X %02X %s\n",i,found[i],(info && info[i] && info[i][0]) ? info[i] : "-");
 	}
-	if(i==0 && ERROR_CHECK){
-		i2c_error("I2C_RX / no ACK (Reading)");
+	fclose(fp);
+	if(rename(tmp,path)){
+		remove(tmp);
+		_bus_error(b,"i2c_inventory_save / rename Error");
 		return 0;
 	}
-	for(i=10;i>0;i--){
-		_delayMicroseconds(I2C_RAMDA);
-		if( digitalRead(PORT_SCL)==1  ) break;
+	return 1;
+}
+
+int i2c_inventory_ex(i2c_bus *b, byte adr){
+/*
+保存した検索結果で adr が応答したレーンを返す (bit0:レーン0)
+戻り値：-1 検索結果が無い(通信して確認する)、0 応答なし
+*/
+	FILE *fp;
+	char path[S_PATH];
+	char line[80];
+	unsigned int a,lanes;
+	int ret=0;
+	fp=fopen(_inventory_path(b,path),"r");
+	if(fp==NULL) return -1;
+	while(fgets(line,sizeof(line),fp)){
+		if(sscanf(line,"%x %x",&a,&lanes)==2 && a==adr) ret=(int)lanes;
 	}
-	if(i==0 && ERROR_CHECK){
-		i2c_error("I2C_RX / Clock Line Holded");
-		return 0;
+	fclose(fp);
+	return ret;
+}
+
+static int _cal_id_reg(byte adr){
+// 自動調整でチップIDを読み返すレジスタ (-1:ACKのみで判定)
+	switch(adr){
+		case 0x76: case 0x77: return 0xD0;	// BME280
+		case 0x1D: case 0x53: return 0x00;	// ADXL345
+		case 0x5D: return 0x0F;				// LPS25H (0x5C は AM2320 と共用のため除外)
+		case 0x5A: case 0x5B: return 0x20;	// CCS811
 	}
-	/* 受信データ */
-	for(ret=0;ret<len;ret++){
-		i2c_SCL(0);							// (SCL)	L Out
-		i2c_SDA(1);							// (SDA)	H Imp
-		rx[ret]=0x00;
-		for(i=0;i<8;i++){
-			i2c_SCL(1);						// (SCL)	H Imp
-			rx[ret] |= (digitalRead(PORT_SDA))<<(7-i);		//data[22] b4=Port 12(SDA)
-			i2c_SCL(0);						// (SCL)	L Out
-		}
-		if(ret<len-1){
-			// ACKを応答する
-			i2c_SDA(0);							// (SDA)	L Out
-			i2c_SCL(1);							// (SCL)	H Imp
-			_delayMicroseconds(I2C_RAMDA);
+	return -1;
+}
+
+static byte _cal_trial(i2c_bus *b, byte adr, int reg, byte ref){
+// 設定中のシンボル長で CAL_TRIAL 回通信し、全て成功すれば１
+	byte tx=(byte)reg, rx;
+	int i;
+	for(i=0;i<CAL_TRIAL;i++){
+		if(reg<0){
+			if( !i2c_check_ex(b,adr) ) break;
 		}else{
-			// NACKを応答する
-			i2c_SDA(1);							// (SDA)	H Imp
-			i2c_SCL(1);							// (SCL)	H Imp
-			_delayMicroseconds(I2C_RAMDA);
+			rx=~ref;
+			if( i2c_write_read_ex(b,adr,&tx,1,&rx,1)!=1 || rx!=ref ) break;
 		}
 	}
-	/* STOP */
-	i2c_SCL(0);								// (SCL)	L Out
-	i2c_SDA(0);								// (SDA)	L Out
-	_delayMicroseconds(I2C_RAMDA);
-	i2c_SCL(1);								// (SCL)	H Imp
-	_delayMicroseconds(I2C_RAMDA);
-	i2c_SDA(1);								// (SDA)	H Imp
-	return ret;
+	if(i==CAL_TRIAL) return 1;
+	b->ramda=b->ramda_def;					// 既定の速度で STOP を出しておく
+	_i2c_stop(b);
+	return 0;
 }
 
-byte i2c_write(byte adr, byte *tx, byte len){
+uint32_t i2c_calibrate_ex(i2c_bus *b, byte adr){
 /*
+NACK もチップIDの読み違いも出ない最短のシンボル長を二分探索し、アドレス別に設定する
 入力：byte adr = I2Cアドレス(7ビット)
-入力：byte *tx = 送信データ用ポインタ
-入力：byte len = 送信データ長（0のときはアドレスのみを送信する）
-戻り値：０の時はエラー(または送信データ長0)
+戻り値：設定したシンボル長[ns]、０の時はエラー(応答なし、または i2c-dev)
 */
-	byte ret=0;
-	if( !i2c_start() ) return 0;
-	adr <<= 1;								// 7ビット->8ビット
-	adr &= 0xFE;							// RW=0 送信モード
-	if( i2c_tx(adr)>0 ){
-		/* データ送信 */
-		for(ret=0;ret<len;ret++){
-			i2c_SDA(0);						// (SDA)	L Out
-			i2c_SCL(0);						// (SCL)	L Out
-			if( i2c_tx(tx[ret]) == 0 && ERROR_CHECK){
-				i2c_error("i2c_write / no ACK (Writing)");
-				return 0;
-			}
-		}
-	}else if( len>0 && ERROR_CHECK){		// len=0の時はエラーにしないAM2320用
-		i2c_error("i2c_write / no ACK (Address)");
-		return 0;
+	int reg=_cal_id_reg(adr);
+	int check=b->error_check;
+	byte tx,ref=0,quiet=b->quiet;
+	uint32_t lo=RAMDA_MIN, hi=b->ramda_def, mid;
+
+	if(b->backend>=I2C_DEV_IO || adr>=128) return 0;	// ビットバング以外は調整しない
+	b->error_check=1;
+	b->quiet=1;
+	b->ramda_adr[adr]=b->ramda_def;			// 既定の速度で基準値を読む
+	if(reg>=0){
+		tx=(byte)reg;
+		if( i2c_write_read_ex(b,adr,&tx,1,&ref,1)!=1 ) reg=-1;	// 読めなければ ACK のみで判定
 	}
-	/* STOP */
-	i2c_SDA(0);								// (SDA)	L Out
-	i2c_SCL(0);								// (SCL)	L Out
-	_delayMicroseconds(I2C_RAMDA);
-	if(len==0)_delayMicroseconds(800);		// AM2320用
-	i2c_SCL(1);								// (SCL)	H Imp
-	_delayMicroseconds(I2C_RAMDA);
-	i2c_SDA(1);								// (SDA)	H Imp
-	return ret;
+	if( !_cal_trial(b,adr,reg,ref) ) hi=0;
+	while(hi && hi-lo > hi/16){
+		mid=(lo+hi)/2;
+		b->ramda_adr[adr]=mid;
+		if( _cal_trial(b,adr,reg,ref) ) hi=mid; else lo=mid;
+	}
+	hi += hi/4;								// 25% の余裕を持たせる
+	if(hi>b->ramda_def) hi=b->ramda_def;
+	b->ramda_adr[adr]=hi;
+	b->error_check=check;
+	b->quiet=quiet;
+	return hi;
 }
 
-byte i2c_lcd_out(byte y,byte *lcd){
+byte i2c_lcd_out_ex(i2c_bus *b, byte y,byte *lcd){
 // 戻り値：０の時はエラー
 	byte data[2];
 	byte i;
@@ -446,12 +2939,12 @@ byte i2c_lcd_out(byte y,byte *lcd){
 		data[1]=0xC0;
 		y=1;
 	}
-	ret += !i2c_write(I2C_lcd,data,2);
-	for(i=0;i<_lcd_size_x;i++){
+	ret += !i2c_write_ex(b,I2C_lcd,data,2);
+	for(i=0;i<b->lcd_x;i++){
 		if(lcd[i]==0x00) break;
 		data[0]=0x40;
 		data[1]=lcd[i];
-		ret += !i2c_write(I2C_lcd,data,2);
+		ret += !i2c_write_ex(b,I2C_lcd,data,2);
 	}
 	#ifdef DEBUG
 		if(ret)fprintf(stderr,"ERROR LOD_OUT Y=%d [%s]\n",y,lcd);
@@ -478,33 +2971,33 @@ void utf_del_uni(char *s){
 	// fprintf(stderr,"len=%d\n",j);
 }
 
-	byte i2c_lcd_print(char *s);
+	byte i2c_lcd_print_ex(i2c_bus *b, char *s);
 
-byte i2c_lcd_init(void){
+byte i2c_lcd_init_ex(i2c_bus *b){
 // 戻り値：０の時はエラー
 	byte ret=0;
 	byte data[2];
 
-	data[0]=0x00; data[1]=0x39; ret+=!i2c_write(I2C_lcd,data,2);	// IS=1
-	data[0]=0x00; data[1]=0x11; ret+=!i2c_write(I2C_lcd,data,2);	// OSC
-	data[0]=0x00; data[1]=0x70; ret+=!i2c_write(I2C_lcd,data,2);	// コントラスト	0
-	data[0]=0x00; data[1]=0x56; ret+=!i2c_write(I2C_lcd,data,2);	// Power/Cont	6
-	data[0]=0x00; data[1]=0x6C; ret+=!i2c_write(I2C_lcd,data,2);	// FollowerCtrl	C
+	data[0]=0x00; data[1]=0x39; ret+=!i2c_write_ex(b,I2C_lcd,data,2);	// IS=1
+	data[0]=0x00; data[1]=0x11; ret+=!i2c_write_ex(b,I2C_lcd,data,2);	// OSC
+	data[0]=0x00; data[1]=0x70; ret+=!i2c_write_ex(b,I2C_lcd,data,2);	// コントラスト	0
+	data[0]=0x00; data[1]=0x56; ret+=!i2c_write_ex(b,I2C_lcd,data,2);	// Power/Cont	6
+	data[0]=0x00; data[1]=0x6C; ret+=!i2c_write_ex(b,I2C_lcd,data,2);	// FollowerCtrl	C
 	delay(200);
-	data[0]=0x00; data[1]=0x38; ret+=!i2c_write(I2C_lcd,data,2);	// IS=0
-	data[0]=0x00; data[1]=0x0C; ret+=!i2c_write(I2C_lcd,data,2);	// DisplayON	C
-//	i2c_lcd_print("Hello!  I2C LCD by Wataru Kunino");
+	data[0]=0x00; data[1]=0x38; ret+=!i2c_write_ex(b,I2C_lcd,data,2);	// IS=0
+	data[0]=0x00; data[1]=0x0C; ret+=!i2c_write_ex(b,I2C_lcd,data,2);	// DisplayON	C
+//	i2c_lcd_print_ex(b,"Hello!  I2C LCD by Wataru Kunino");
 	return !ret;
 }
 
-byte i2c_lcd_init_xy(byte x, byte y){
+byte i2c_lcd_init_xy_ex(i2c_bus *b, byte x, byte y){
 // 戻り値：０の時はエラー
-	if(x==16||x==8||x==20) _lcd_size_x=x;
-	if(y==1 ||y==2) _lcd_size_y=y;
-	return i2c_lcd_init();
+	if(x==16||x==8||x==20) b->lcd_x=x;
+	if(y==1 ||y==2) b->lcd_y=y;
+	return i2c_lcd_init_ex(b);
 }
 
-byte i2c_lcd_print(char *s){
+byte i2c_lcd_print_ex(i2c_bus *b, char *s){
 // 戻り値：０の時はエラー
 	byte i,j;
 	char str[65];
@@ -514,25 +3007,25 @@ byte i2c_lcd_print(char *s){
 	strncpy(str,s,64);
 	utf_del_uni(str);
 	for(j=0;j<2;j++){
-		lcd[_lcd_size_x]='\0';
-		for(i=0;i<_lcd_size_x;i++){
-			lcd[i]=(byte)str[i+_lcd_size_x*j];
+		lcd[b->lcd_x]='\0';
+		for(i=0;i<b->lcd_x;i++){
+			lcd[i]=(byte)str[i+b->lcd_x*j];
 			if(lcd[i]==0x00){
-				for(;i<_lcd_size_x;i++) lcd[i]=' ';
-				ret += !i2c_lcd_out(j,lcd);
+				for(;i<b->lcd_x;i++) lcd[i]=' ';
+				ret += !i2c_lcd_out_ex(b,j,lcd);
 				if(j==0){
-					for(i=0;i<_lcd_size_x;i++) lcd[i]=' ';
-					ret += !i2c_lcd_out(1,lcd);
+					for(i=0;i<b->lcd_x;i++) lcd[i]=' ';
+					ret += !i2c_lcd_out_ex(b,1,lcd);
 				}
 				return !ret;
 			}
 		}
-		ret += !i2c_lcd_out(j,lcd);
+		ret += !i2c_lcd_out_ex(b,j,lcd);
 	}
 	return !ret;
 }
 
-byte i2c_lcd_print2(char *s){
+byte i2c_lcd_print2_ex(i2c_bus *b, char *s){
 // 戻り値：０の時はエラー
 	byte ret=0;
 	byte i;
@@ -541,25 +3034,25 @@ byte i2c_lcd_print2(char *s){
 	
 	strncpy(str,s,64);
 	utf_del_uni(str);
-	lcd[_lcd_size_x]='\0';
-	for(i=0;i<_lcd_size_x;i++){
+	lcd[b->lcd_x]='\0';
+	for(i=0;i<b->lcd_x;i++){
 		lcd[i]=(byte)str[i];
 		if(lcd[i]==0x00){
-			for(;i<_lcd_size_x;i++) lcd[i]=' ';
-			ret += !i2c_lcd_out(1,lcd);
+			for(;i<b->lcd_x;i++) lcd[i]=' ';
+			ret += !i2c_lcd_out_ex(b,1,lcd);
 			return !ret;
 		}
 	}
-	ret += !i2c_lcd_out(1,lcd);
+	ret += !i2c_lcd_out_ex(b,1,lcd);
 	return !ret;
 }
 
 
-byte i2c_lcd_print_ip(uint32_t ip){
+byte i2c_lcd_print_ip_ex(i2c_bus *b, uint32_t ip){
 // 戻り値：０の時はエラー
 	char lcd[21];
 	
-	if(_lcd_size_x<=8){
+	if(b->lcd_x<=8){
 		sprintf(lcd,"%i.%i.    ",
 			ip & 255,
 			ip>>8 & 255
@@ -576,10 +3069,10 @@ byte i2c_lcd_print_ip(uint32_t ip){
 			ip>>24
 		);
 	}
-	return i2c_lcd_print(lcd);
+	return i2c_lcd_print_ex(b,lcd);
 }
 
-byte i2c_lcd_print_ip2(uint32_t ip){
+byte i2c_lcd_print_ip2_ex(i2c_bus *b, uint32_t ip){
 // 戻り値：０の時はエラー
 	char lcd[21];
 	
@@ -589,17 +3082,17 @@ byte i2c_lcd_print_ip2(uint32_t ip){
 		ip>>16 & 255,
 		ip>>24
 	);
-	if(_lcd_size_x>=16) return i2c_lcd_print2(lcd);
-	else return i2c_lcd_print(lcd);
+	if(b->lcd_x>=16) return i2c_lcd_print2_ex(b,lcd);
+	else return i2c_lcd_print_ex(b,lcd);
 }
 
-byte i2c_lcd_print_val(char *s,int in){
+byte i2c_lcd_print_val_ex(i2c_bus *b, char *s,int in){
 // 戻り値：０の時はエラー
 	byte ret=0;
 	char lcd[21];
 	sprintf(lcd,"%d",in);
-	ret += !i2c_lcd_print(s);
-	ret += !i2c_lcd_print2(lcd);
+	ret += !i2c_lcd_print_ex(b,s);
+	ret += !i2c_lcd_print2_ex(b,lcd);
 	return !ret;
 }
 
@@ -688,23 +3181,178 @@ void time2txt(char *date,unsigned long local){
 	sprintf(date,"%4d/%02d/%02d,%02d:%02d:%02d",Year,Month,Day,Hour,Minute,Second);
 }
 
-byte i2c_lcd_print_time(unsigned long local){
+byte i2c_lcd_print_time_ex(i2c_bus *b, unsigned long local){
 // 戻り値：０の時はエラー
 	byte ret=0;
 	char date[20];	//	0123456789012345678
 					//	2014/01/01,12:34:56
 	
 	time2txt(date,local);
-	if(_lcd_size_x<=8){
+	if(b->lcd_x<=8){
 		date[10]='\0';
-		ret += !i2c_lcd_print(&date[2]);
-		ret += !i2c_lcd_print2(&date[11]);
-	}else if(_lcd_size_x>=19){
-		ret += !i2c_lcd_print(date);
-	}else if(_lcd_size_x>=10){
+		ret += !i2c_lcd_print_ex(b,&date[2]);
+		ret += !i2c_lcd_print2_ex(b,&date[11]);
+	}else if(b->lcd_x>=19){
+		ret += !i2c_lcd_print_ex(b,date);
+	}else if(b->lcd_x>=10){
 		date[10]='\0';
-		ret += !i2c_lcd_print(date);
-		ret += !i2c_lcd_print2(&date[11]);
+		ret += !i2c_lcd_print_ex(b,date);
+		ret += !i2c_lcd_print2_ex(b,&date[11]);
 	}
 	return !ret;
 }
+
+/* 既定のバス(SDA=GPIO2, SCL=GPIO3)で動作する従来の関数
+	それぞれ i2c_*_ex に i2c_bus_default() を渡す。
+*/
+void i2c_set_speed(uint32_t hz){
+	i2c_set_speed_ex(i2c_bus_default(),hz);
+}
+
+uint32_t i2c_scl_stats(double *hz, double *jitter_ns){
+	return i2c_scl_stats_ex(i2c_bus_default(),hz,jitter_ns);
+}
+
+const char *i2c_bus_name(void){
+	return i2c_bus_name_ex(i2c_bus_default());
+}
+
+const char *i2c_backend_name(void){
+	return i2c_backend_name_ex(i2c_bus_default());
+}
+
+byte i2c_SCL(byte level){
+	return i2c_SCL_ex(i2c_bus_default(),level);
+}
+
+byte i2c_SDA(byte level){
+	return i2c_SDA_ex(i2c_bus_default(),level);
+}
+
+byte i2c_tx(const byte in){
+	return i2c_tx_ex(i2c_bus_default(),in);
+}
+
+byte i2c_recover(void){
+	return i2c_recover_ex(i2c_bus_default());
+}
+
+uint32_t i2c_recover_stats(uint32_t *failed, double *avg_us, double *max_us){
+	return i2c_recover_stats_ex(i2c_bus_default(),failed,avg_us,max_us);
+}
+
+uint32_t i2c_lock_stats(uint32_t *timeouts, double *avg_us, double *max_us){
+	return i2c_lock_stats_ex(i2c_bus_default(),timeouts,avg_us,max_us);
+}
+
+uint32_t i2c_io_stats(uint32_t *elided){
+	return i2c_io_stats_ex(i2c_bus_default(),elided);
+}
+
+void i2c_stats_print(void){
+	i2c_stats_print_ex(i2c_bus_default());
+}
+
+byte i2c_scan(byte *found){
+	return i2c_scan_ex(i2c_bus_default(),found);
+}
+
+byte i2c_inventory_save(const byte *found, const char * const *info){
+	return i2c_inventory_save_ex(i2c_bus_default(),found,info);
+}
+
+int i2c_inventory(byte adr){
+	return i2c_inventory_ex(i2c_bus_default(),adr);
+}
+
+int i2c_batch_run(i2c_batch *q){
+	return i2c_batch_run_ex(i2c_bus_default(),q);
+}
+
+byte i2c_mux_select(byte mux, byte ch){
+	return i2c_mux_select_ex(i2c_bus_default(),mux,ch);
+}
+
+byte i2c_mux_write_read(byte mux, byte ch, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen){
+	return i2c_mux_write_read_ex(i2c_bus_default(),mux,ch,adr,tx,txlen,rx,rxlen);
+}
+
+int i2c_mux_run(i2c_mux_op *ops, int n){
+	return i2c_mux_run_ex(i2c_bus_default(),ops,n);
+}
+
+uint32_t i2c_mux_stats(uint32_t *skipped){
+	return i2c_mux_stats_ex(i2c_bus_default(),skipped);
+}
+
+byte i2c_init(void){
+	return i2c_init_ex(i2c_bus_default());
+}
+
+byte i2c_close(void){
+	return i2c_close_ex(i2c_bus_default());
+}
+
+byte i2c_start(void){
+	return i2c_start_ex(i2c_bus_default());
+}
+
+byte i2c_check(byte adr){
+	return i2c_check_ex(i2c_bus_default(),adr);
+}
+
+byte i2c_read(byte adr, byte *rx, byte len){
+	return i2c_read_ex(i2c_bus_default(),adr,rx,len);
+}
+
+byte i2c_write_read(byte adr, byte *tx, byte txlen, byte *rx, byte rxlen){
+	return i2c_write_read_ex(i2c_bus_default(),adr,tx,txlen,rx,rxlen);
+}
+
+byte i2c_write(byte adr, byte *tx, byte len){
+	return i2c_write_ex(i2c_bus_default(),adr,tx,len);
+}
+
+byte i2c_timing_save(void){
+	return i2c_timing_save_ex(i2c_bus_default());
+}
+
+uint32_t i2c_calibrate(byte adr){
+	return i2c_calibrate_ex(i2c_bus_default(),adr);
+}
+
+byte i2c_lcd_out(byte y,byte *lcd){
+	return i2c_lcd_out_ex(i2c_bus_default(),y,lcd);
+}
+
+byte i2c_lcd_init(void){
+	return i2c_lcd_init_ex(i2c_bus_default());
+}
+
+byte i2c_lcd_init_xy(byte x, byte y){
+	return i2c_lcd_init_xy_ex(i2c_bus_default(),x,y);
+}
+
+byte i2c_lcd_print(char *s){
+	return i2c_lcd_print_ex(i2c_bus_default(),s);
+}
+
+byte i2c_lcd_print2(char *s){
+	return i2c_lcd_print2_ex(i2c_bus_default(),s);
+}
+
+byte i2c_lcd_print_ip(uint32_t ip){
+	return i2c_lcd_print_ip_ex(i2c_bus_default(),ip);
+}
+
+byte i2c_lcd_print_ip2(uint32_t ip){
+	return i2c_lcd_print_ip2_ex(i2c_bus_default(),ip);
+}
+
+byte i2c_lcd_print_val(char *s,int in){
+	return i2c_lcd_print_val_ex(i2c_bus_default(),s,in);
+}
+
+byte i2c_lcd_print_time(unsigned long local){
+	return i2c_lcd_print_time_ex(i2c_bus_default(),local);
+}
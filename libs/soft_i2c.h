@@ -16,8 +16,12 @@ Arduino標準ライブラリ「Wire」は使用していない(I2Cの手順の
 //														2017/6/16	国野亘
 
 #include <stdint.h>
+#include "i2c_bench.h"					// --bench N (i2c_bench_opt 等)
 
 typedef unsigned char byte; 
+typedef struct i2c_bus i2c_bus;			// バスごとの状態(ピン、GPIO 方式、タイミング、エラー処理)
+#define I2C_SCAN_FIRST	8				// i2c_scan で確認するアドレスの範囲
+#define I2C_SCAN_LAST	119
 void delay(int i);
 byte pinMode(char *port, char *mode);
 byte digitalRead(char *port);
@@ -28,12 +32,28 @@ byte i2c_hard_reset(int port);
 byte i2c_SCL(byte level);
 byte i2c_SDA(byte level);
 byte i2c_tx(const byte in);
+void i2c_set_speed(uint32_t hz);
+uint32_t i2c_scl_stats(double *hz, double *jitter_ns);
+uint32_t i2c_calibrate(byte adr);
+byte i2c_timing_save(void);
 byte i2c_init(void);
+const char *i2c_backend_name(void);
+const char *i2c_bus_name(void);
 byte i2c_close(void);
 byte i2c_start(void);
+byte i2c_recover(void);
+uint32_t i2c_recover_stats(uint32_t *failed, double *avg_us, double *max_us);
+uint32_t i2c_lock_stats(uint32_t *timeouts, double *avg_us, double *max_us);
+uint32_t i2c_io_stats(uint32_t *elided);
+void i2c_stats_opt(int *argc, char **argv);
+void i2c_stats_print(void);
 byte i2c_check(byte adr);
+byte i2c_scan(byte *found);
+byte i2c_inventory_save(const byte *found, const char * const *info);
+int i2c_inventory(byte adr);
 byte i2c_read(byte adr, byte *rx, byte len);
 byte i2c_write(byte adr, byte *tx, byte len);
+byte i2c_write_read(byte adr, byte *tx, byte txlen, byte *rx, byte rxlen);
 byte i2c_lcd_out(byte y,byte *lcd);
 void utf_del_uni(char *s);
 byte i2c_lcd_init(void);
@@ -44,3 +64,107 @@ byte i2c_lcd_print_ip(uint32_t ip);
 byte i2c_lcd_print_ip2(uint32_t ip);
 byte i2c_lcd_print_val(char *s,int in);
 byte i2c_lcd_print_time(unsigned long local);
+
+/* 一括実行(バッチ)  命令を並べて1回の呼出しで実行する(初期設定の書込みなど)
+	i2c_batch q; i2c_batch_clear(&q); i2c_batch_write(&q,adr,tx,2); ... i2c_batch_run(&q);
+	i2c-dev では複数メッセージの I2C_RDWR、i2cd では1回の要求として実行する。
+	エラーの命令で実行を止め、各命令の結果を ops[].status に返す。
+*/
+#define I2C_BATCH_OPS		32				// 命令数の上限
+#define I2C_BATCH_BUF		256				// 送信データの合計の上限
+#define I2C_BATCH_READ		1				// 命令の種類 (libs/i2cd.h と同じ値)
+#define I2C_BATCH_WRITE		2
+#define I2C_BATCH_WRITE_READ 3
+#define I2C_BATCH_DELAY		4
+typedef struct {
+	byte op;								// 命令の種類
+	byte adr;								// I2Cアドレス(7ビット)
+	byte txlen, rxlen;						// 送信長、受信長
+	uint16_t tx;							// 送信データの位置 (buf 内)
+	uint16_t ms;							// I2C_BATCH_DELAY: 直前の命令の完了からの待ち時間[ms]
+	byte *rx;								// 受信データの格納先
+	byte status;							// 結果 (0:エラーまたは未実行)
+} i2c_batch_op;
+typedef struct {
+	int n;									// 命令数
+	int len;								// buf の使用量
+	byte overflow;							// 1:上限を超えた命令がある
+	i2c_batch_op ops[I2C_BATCH_OPS];
+	byte buf[I2C_BATCH_BUF];				// 送信データ(追加時に複写)
+} i2c_batch;
+void i2c_batch_clear(i2c_batch *q);
+byte i2c_batch_write(i2c_batch *q, byte adr, const byte *tx, byte len);
+byte i2c_batch_read(i2c_batch *q, byte adr, byte *rx, byte len);
+byte i2c_batch_write_read(i2c_batch *q, byte adr, const byte *tx, byte txlen, byte *rx, byte rxlen);
+byte i2c_batch_delay(i2c_batch *q, uint16_t ms);
+int i2c_batch_run(i2c_batch *q);
+
+/* I2C マルチプレクサ TCA9548A  デバイスを (mux, チャネル, アドレス) で指定する
+	選択中のチャネルを覚えておき、変わるときだけ選択を書き込む(i2c_close で解除)。
+	i2c_mux_run は並べた通信をチャネルごとにまとめて実行する。
+*/
+#define I2C_MUX_TX			4				// i2c_mux_op の送信データの上限
+typedef struct {
+	byte mux;								// TCA9548A のアドレス (0:mux を通さない)
+	byte ch;								// チャネル 0～7
+	byte adr;								// デバイスの I2Cアドレス(7ビット)
+	byte txlen, rxlen;						// 送信長、受信長 (0:送信のみ)
+	byte tx[I2C_MUX_TX];					// 送信データ(レジスタ番号など)
+	byte *rx;								// 受信データの格納先
+	byte status;							// 結果 (0:エラー)
+} i2c_mux_op;
+byte i2c_mux_select(byte mux, byte ch);
+byte i2c_mux_write_read(byte mux, byte ch, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen);
+int i2c_mux_run(i2c_mux_op *ops, int n);
+uint32_t i2c_mux_stats(uint32_t *skipped);
+
+/* 複数のバス(ピンの組)を使う場合 (スレッドごとに別のバスを使用可)
+	i2c_bus *bus=i2c_bus_new(SDA,SCL); i2c_init_ex(bus); ... i2c_close_ex(bus); i2c_bus_free(bus);
+	上記の i2c_* 関数は i2c_bus_default() (SDA=GPIO2, SCL=GPIO3) を使用する。
+	i2c_stats_opt, i2c_bench_* (集計はプロセスに1つ)と sim 方式(模擬バスは
+	プロセスに1つ)は、1つのスレッドからのみ使用する。
+*/
+i2c_bus *i2c_bus_new(int sda, int scl);
+i2c_bus *i2c_bus_new_lanes(const int *sda, int lanes, int scl);
+void i2c_bus_free(i2c_bus *b);
+i2c_bus *i2c_bus_default(void);
+void i2c_set_error_check_ex(i2c_bus *b, int check);
+byte i2c_SCL_ex(i2c_bus *b, byte level);
+byte i2c_SDA_ex(i2c_bus *b, byte level);
+byte i2c_tx_ex(i2c_bus *b, const byte in);
+void i2c_set_speed_ex(i2c_bus *b, uint32_t hz);
+uint32_t i2c_scl_stats_ex(i2c_bus *b, double *hz, double *jitter_ns);
+uint32_t i2c_calibrate_ex(i2c_bus *b, byte adr);
+byte i2c_timing_save_ex(i2c_bus *b);
+byte i2c_init_ex(i2c_bus *b);
+const char *i2c_backend_name_ex(i2c_bus *b);
+const char *i2c_bus_name_ex(i2c_bus *b);
+byte i2c_close_ex(i2c_bus *b);
+byte i2c_start_ex(i2c_bus *b);
+byte i2c_recover_ex(i2c_bus *b);
+uint32_t i2c_recover_stats_ex(i2c_bus *b, uint32_t *failed, double *avg_us, double *max_us);
+uint32_t i2c_lock_stats_ex(i2c_bus *b, uint32_t *timeouts, double *avg_us, double *max_us);
+uint32_t i2c_io_stats_ex(i2c_bus *b, uint32_t *elided);
+void i2c_stats_print_ex(i2c_bus *b);
+byte i2c_check_ex(i2c_bus *b, byte adr);
+byte i2c_scan_ex(i2c_bus *b, byte *found);
+byte i2c_inventory_save_ex(i2c_bus *b, const byte *found, const char * const *info);
+int i2c_inventory_ex(i2c_bus *b, byte adr);
+byte i2c_read_ex(i2c_bus *b, byte adr, byte *rx, byte len);
+byte i2c_write_ex(i2c_bus *b, byte adr, byte *tx, byte len);
+byte i2c_write_read_ex(i2c_bus *b, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen);
+byte i2c_write_read_lanes(i2c_bus *b, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen);
+int i2c_batch_run_ex(i2c_bus *b, i2c_batch *q);
+byte i2c_mux_select_ex(i2c_bus *b, byte mux, byte ch);
+byte i2c_mux_write_read_ex(i2c_bus *b, byte mux, byte ch, byte adr, byte *tx, byte txlen, byte *rx, byte rxlen);
+int i2c_mux_run_ex(i2c_bus *b, i2c_mux_op *ops, int n);
+uint32_t i2c_mux_stats_ex(i2c_bus *b, uint32_t *skipped);
+byte i2c_lcd_out_ex(i2c_bus *b, byte y,byte *lcd);
+byte i2c_lcd_init_ex(i2c_bus *b);
+byte i2c_lcd_init_xy_ex(i2c_bus *b, byte x, byte y);
+byte i2c_lcd_print_ex(i2c_bus *b, char *s);
+byte i2c_lcd_print2_ex(i2c_bus *b, char *s);
+byte i2c_lcd_print_ip_ex(i2c_bus *b, uint32_t ip);
+byte i2c_lcd_print_ip2_ex(i2c_bus *b, uint32_t ip);
+byte i2c_lcd_print_val_ex(i2c_bus *b, char *s,int in);
+byte i2c_lcd_print_time_ex(i2c_bus *b, unsigned long local);